@@ -0,0 +1,281 @@
+#include "CowStorage.h"
+#include "FileException.h"
+#include <algorithm>
+#include <cstring>
+
+const std::size_t CowStorage::BLOCK_SIZE;
+
+// Layers deeper than this are flattened before the file is copied again, so reads stay short walks
+static const std::size_t MAX_DEPTH = 8;
+
+// Copies of files smaller than this are plain copies, freezing would cost more than it saves
+static const std::size_t SHARE_MIN = CowStorage::BLOCK_SIZE;
+
+// Bytes handed to fn at once when scanning a layered file
+static const std::size_t SCAN_PIECE = 1 << 20;
+
+// Number of blocks covering len bytes
+static std::size_t blocks(std::size_t len) {
+    return (len + CowStorage::BLOCK_SIZE - 1) / CowStorage::BLOCK_SIZE;
+}
+
+// Layer destructor: the frozen bytes are no longer read by anyone
+CowStorage::Layer::~Layer() {
+    try {
+        store->remove(path);
+    } catch (const FileException&) {
+        // already gone, nothing left to free
+    }
+}
+
+CowStorage::CowStorage() : inner(nullptr), generation(0) {}
+
+// Destructor: dropping the overlays deletes the layer files
+CowStorage::~CowStorage() {
+    overlays.clear();
+}
+
+// Route every file through the given backend
+void CowStorage::attach(Storage& backend) {
+    std::unique_lock<std::shared_mutex> g(overlayLock);
+    overlays.clear();
+    inner = &backend;
+}
+
+// Create the backing file if it does not exist yet
+void CowStorage::create(const std::string& path) {
+    inner->create(path);
+}
+
+// Delete the file; its layers go with the last file reading them
+bool CowStorage::remove(const std::string& path) {
+    std::unique_lock<std::shared_mutex> g(overlayLock);
+    overlays.erase(path);
+    return inner->remove(path);
+}
+
+// Read through the layers when the file still shares blocks
+std::size_t CowStorage::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    auto it = overlays.find(path);
+    if (it == overlays.end()) return inner->read(path, offset, buf, len);
+    return readLayered(path, it->second, offset, buf, len);
+}
+
+// Copy the touched shared blocks into the file before writing; once every block is its own, the layers are dropped.
+// Plain files are written under the shared lock, layered ones under the exclusive lock
+void CowStorage::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    {
+        std::shared_lock<std::shared_mutex> g(overlayLock);
+        if (overlays.find(path) == overlays.end() || len == 0) {
+            inner->write(path, offset, buf, len);
+            return;
+        }
+    }
+    std::unique_lock<std::shared_mutex> g(overlayLock);
+    auto it = overlays.find(path);
+    if (it == overlays.end()) {  // dropped while the lock was released
+        inner->write(path, offset, buf, len);
+        return;
+    }
+    Overlay& o = it->second;
+    std::size_t first = offset / BLOCK_SIZE, last = (offset + len - 1) / BLOCK_SIZE;
+    for (std::size_t b = first; b <= last && b < o.own.size(); ++b) {
+        if (o.own[b]) continue;
+        std::size_t start = b * BLOCK_SIZE;
+        std::size_t valid = std::min(BLOCK_SIZE, o.below->length - start);
+        if (offset <= start && offset + len >= start + valid) {
+            o.own[b] = true;  // overwritten entirely, nothing to copy
+            ++o.owned;
+        } else {
+            copyUp(path, o, b);
+        }
+    }
+    inner->write(path, offset, buf, len);
+    o.length = std::max(o.length, offset + len);
+    if (o.owned == o.own.size()) overlays.erase(it);
+}
+
+// O(1) copy: reflink when the filesystem can, otherwise share the source's frozen blocks
+void CowStorage::copy(const std::string& source, const std::string& target) {
+    std::unique_lock<std::shared_mutex> g(overlayLock);
+    if (source == target) return;
+    auto it = overlays.find(source);
+    if (it == overlays.end()) {
+        overlays.erase(target);
+        if (inner->length(source) < SHARE_MIN) {
+            inner->copy(source, target);
+            return;
+        }
+        if (inner->clone(source, target)) return;
+    }
+    std::shared_ptr<Layer> layer = freeze(source);
+    overlays.erase(target);
+    inner->remove(target);
+    inner->create(target);
+    Overlay& o = overlays[target];
+    o.length = layer->length;
+    o.own.assign(blocks(layer->length), false);
+    o.owned = 0;
+    o.below = layer;
+}
+
+// Imports go straight to the backend; the caller empties files that copies may share blocks with first
+std::size_t CowStorage::importFile(const std::string& hostPath, const std::string& path) {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    if (overlays.count(path)) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Cannot import over a file that shares blocks: " + path);
+    }
+    return inner->importFile(hostPath, path);
+}
+
+// Rename the backing file and carry the overlay along
+void CowStorage::rename(const std::string& from, const std::string& to) {
+    std::unique_lock<std::shared_mutex> g(overlayLock);
+    overlays.erase(to);
+    inner->rename(from, to);
+    auto it = overlays.find(from);
+    if (it == overlays.end()) return;
+    overlays[to] = std::move(it->second);
+    overlays.erase(from);
+}
+
+// Logical length, from the overlay when the file is layered
+std::size_t CowStorage::length(const std::string& path) {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    auto it = overlays.find(path);
+    return it == overlays.end() ? inner->length(path) : it->second.length;
+}
+
+// Layered files are read block by block into large pieces
+void CowStorage::scan(const std::string& path, const ChunkFn& fn) {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    auto it = overlays.find(path);
+    if (it == overlays.end()) inner->scan(path, fn);
+    else scanLayered(path, it->second, fn);
+}
+
+// Layered files have no single backing file to hand to the kernel
+bool CowStorage::sendTo(const std::string& path, int outFd, std::size_t& sent) {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    sent = 0;
+    if (overlays.count(path)) return false;
+    return inner->sendTo(path, outFd, sent);
+}
+
+// Layers are never written after they are frozen, so the file's own backing file tells every change
+std::uint64_t CowStorage::stamp(const std::string& path) {
+    return inner->stamp(path);
+}
+
+// Number of files still sharing blocks with a copy
+std::size_t CowStorage::sharedFiles() {
+    std::shared_lock<std::shared_mutex> g(overlayLock);
+    return overlays.size();
+}
+
+void CowStorage::flushAll() {
+    inner->flushAll();
+}
+
+void CowStorage::syncAll() {
+    inner->syncAll();
+}
+
+void CowStorage::closeAll() {
+    inner->closeAll();
+}
+
+// Move the file's bytes into a new frozen layer, leaving the file as an empty overlay on it
+std::shared_ptr<CowStorage::Layer> CowStorage::freeze(const std::string& path) {
+    auto it = overlays.find(path);
+    if (it != overlays.end() && it->second.below->depth + 1 >= MAX_DEPTH) {
+        flatten(path);
+        it = overlays.end();
+    }
+    std::shared_ptr<Layer> layer = std::make_shared<Layer>();
+    layer->store = inner;
+    layer->path = path + " cow" + std::to_string(++generation);  // tokens never hold spaces, so no file clashes
+    if (it != overlays.end()) {
+        layer->length = it->second.length;
+        layer->own = std::move(it->second.own);
+        layer->below = it->second.below;
+        layer->depth = layer->below->depth + 1;
+    } else {
+        layer->length = inner->length(path);
+        layer->depth = 0;
+    }
+    inner->rename(path, layer->path);
+    inner->create(path);
+    Overlay& o = overlays[path];
+    o.length = layer->length;
+    o.own.assign(blocks(layer->length), false);
+    o.owned = 0;
+    o.below = layer;
+    return layer;
+}
+
+// Rewrite a layered file into a self-contained backing file
+void CowStorage::flatten(const std::string& path) {
+    const Overlay& o = overlays.at(path);
+    std::string tmp = path + " flat";
+    inner->remove(tmp);
+    inner->create(tmp);
+    std::vector<char> buf(SCAN_PIECE);
+    for (std::size_t off = 0; off < o.length; off += buf.size()) {
+        std::size_t n = readLayered(path, o, off, buf.data(), buf.size());
+        inner->write(tmp, off, buf.data(), n);
+    }
+    overlays.erase(path);
+    inner->rename(tmp, path);
+}
+
+// Copy one block from the layers into the file's own backing file
+void CowStorage::copyUp(const std::string& path, Overlay& o, std::size_t block) {
+    std::size_t start = block * BLOCK_SIZE;
+    std::size_t valid = std::min(BLOCK_SIZE, o.below->length - start);
+    std::vector<char> buf(valid);
+    std::size_t n = inner->read(holder(path, o, block), start, buf.data(), valid);
+    inner->write(path, start, buf.data(), n);
+    o.own[block] = true;
+    ++o.owned;
+}
+
+// Read block by block, one backend read per run of blocks held by the same file
+std::size_t CowStorage::readLayered(const std::string& path, const Overlay& o, std::size_t offset,
+                                    char* buf, std::size_t len) {
+    if (offset >= o.length) return 0;
+    len = std::min(len, o.length - offset);
+    std::size_t done = 0;
+    while (done < len) {
+        std::size_t pos = offset + done;
+        std::size_t block = pos / BLOCK_SIZE;
+        const std::string& src = holder(path, o, block);
+        std::size_t end = (block + 1) * BLOCK_SIZE;
+        while (end < offset + len && &holder(path, o, end / BLOCK_SIZE) == &src) end += BLOCK_SIZE;
+        std::size_t n = std::min(end, offset + len) - pos;
+        std::size_t got = inner->read(src, pos, buf + done, n);
+        if (got < n) std::memset(buf + done + got, 0, n - got);  // holes in sparse layer files read as zeros
+        done += n;
+    }
+    return done;
+}
+
+// Pass a layered file to fn in large pieces
+void CowStorage::scanLayered(const std::string& path, const Overlay& o, const ChunkFn& fn) {
+    std::vector<char> buf(std::min(SCAN_PIECE, o.length));
+    for (std::size_t off = 0; off < o.length; off += buf.size()) {
+        std::size_t n = readLayered(path, o, off, buf.data(), buf.size());
+        if (n == 0) break;
+        fn(buf.data(), n);
+    }
+}
+
+// The file itself holds blocks it wrote or that lie past the layers; otherwise the newest layer holding it
+const std::string& CowStorage::holder(const std::string& path, const Overlay& o, std::size_t block) {
+    if (block >= o.own.size() || o.own[block]) return path;
+    const Layer* l = o.below.get();
+    while (l->below && block < l->own.size() && !l->own[block]) l = l->below.get();
+    return l->path;
+}
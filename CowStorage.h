@@ -0,0 +1,92 @@
+#ifndef EX1_COW_STORAGE_H
+#define EX1_COW_STORAGE_H
+
+#include "Storage.h"
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// CowStorage class: front for the selected backend that makes copy() O(1) and lets copies diverge per block.
+// A copy first tries a filesystem reflink. Otherwise the source's bytes are frozen into a hidden layer file
+// that both files read through, and the first write to a block copies only that block into the writer's own
+// backing file. Files that were never copied pass straight through to the backend.
+// Lookups hold the overlay lock shared; copies, removals and writes to layered files hold it exclusively.
+class CowStorage : public Storage {
+public:
+    // Unit of sharing and divergence
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+
+private:
+    // Frozen bytes shared by copies; the backing file is deleted with the last reference
+    struct Layer {
+        Storage* store;                // Backend holding the layer's file
+        std::string path;              // Backing file of the layer
+        std::size_t length;            // Length of the content seen through this layer
+        std::vector<bool> own;         // Blocks of below's range stored in this layer's file
+        std::shared_ptr<Layer> below;  // Older layer supplying the other blocks (null: self-contained)
+        std::size_t depth;             // Number of layers below this one
+
+        ~Layer();
+    };
+
+    // A file whose unwritten blocks still come from a shared layer
+    struct Overlay {
+        std::size_t length;            // Logical file length
+        std::vector<bool> own;         // Blocks of below's range already copied into the file itself
+        std::size_t owned;             // Number of set bits in own
+        std::shared_ptr<Layer> below;  // Layer supplying the blocks not owned yet
+    };
+
+public:
+    CowStorage();
+    ~CowStorage() override;
+
+    // Route every file through the given backend; must happen before any file is created
+    void attach(Storage& backend);
+
+    void create(const std::string& path) override;
+    bool remove(const std::string& path) override;
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) override;
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) override;
+    void copy(const std::string& source, const std::string& target) override;
+    void rename(const std::string& from, const std::string& to) override;
+    std::size_t importFile(const std::string& hostPath, const std::string& path) override;
+    std::size_t length(const std::string& path) override;
+    void scan(const std::string& path, const ChunkFn& fn) override;
+    bool sendTo(const std::string& path, int outFd, std::size_t& sent) override;
+    std::uint64_t stamp(const std::string& path) override;
+    void flushAll() override;
+    void syncAll() override;
+    void closeAll() override;
+
+    // Number of files still sharing blocks with a copy
+    std::size_t sharedFiles();
+
+private:
+    // Move the file's bytes into a new frozen layer and leave the file as an empty overlay on it
+    std::shared_ptr<Layer> freeze(const std::string& path);
+
+    // Rewrite a layered file into a self-contained backing file
+    void flatten(const std::string& path);
+
+    // Copy one block from the layers into the file's own backing file
+    void copyUp(const std::string& path, Overlay& o, std::size_t block);
+
+    // Read from a layered file block by block
+    std::size_t readLayered(const std::string& path, const Overlay& o, std::size_t offset,
+                            char* buf, std::size_t len);
+
+    // Pass a layered file to fn in large pieces
+    void scanLayered(const std::string& path, const Overlay& o, const ChunkFn& fn);
+
+    // Backing file that holds the given block of a layered file
+    static const std::string& holder(const std::string& path, const Overlay& o, std::size_t block);
+
+    Storage* inner;                                     // The selected backend
+    std::shared_mutex overlayLock;                      // Guards overlays and generation
+    std::unordered_map<std::string, Overlay> overlays;  // Layered files by path
+    std::size_t generation;                             // Numbers the layer files
+};
+
+#endif //EX1_COW_STORAGE_H
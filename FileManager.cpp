@@ -1,11 +1,23 @@
 #include "FileManager.h"
+#include "OutputBuffer.h"
+#include "Reaper.h"
+#include "Storage.h"
+#include "WordCount.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <unistd.h>
 
+// std::cout's own buffer, which writes to the process's standard output
+static std::streambuf* const consoleOut = std::cout.rdbuf();
 
-// Constructor
+
+// Constructor: a path still waiting for the reaper is taken over, so the new file starts from nothing
 FileManager::FileManager(const char* filename)
-        : file(new FileValue(filename)), namefile(filename), count(0) {}
+        : file(new FileValue(filename)), namefile(filename), backingKey(std::hash<std::string>()(namefile)) {
+    Reaper::instance().claim(namefile);
+}
 
 // Const operator[]
 Proxy FileManager::operator[](int i) const {
@@ -21,90 +33,110 @@ Proxy FileManager::operator[](int i) {
     return { this, i };
 }
 
+// Read up to length bytes starting at offset with a single cache/disk transfer
+std::string FileManager::read(int offset, int length) const {
+    validateReadStream();
+    validateIndex(offset);
+    if (length < 0) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Length must not be negative.");
+    }
+    std::string out(static_cast<size_t>(std::min(length, getSize() - offset)), '\0');
+    int n = file->read(offset, &out[0], static_cast<int>(out.size()));
+    out.resize(static_cast<size_t>(n));
+    return out;
+}
+
+// Write data starting at offset; the stats are updated once for the whole range
+void FileManager::write(int offset, std::string_view data) {
+    validateWriteStream();
+    validateIndex(offset);
+    if (data.empty()) return;
+    file->write(offset, data.data(), static_cast<int>(data.size()));
+}
+
+// Write data at the end of the file
+void FileManager::append(std::string_view data) {
+    write(getSize(), data);
+}
+
 // Create file
 void FileManager::touch(const char* filename) {
     this->namefile = filename;
-    file->stream->open(namefile, std::ios::out | std::ios::in);
-    if (!file->stream->is_open()) {
-        file->stream->open(namefile, std::ios::out | std::ios::trunc);
-    }
-    file->stream->flush();
-    file->stream->close();
+    file->create();
 }
 
 // Copy contents to another FileManager target
 void FileManager::copy(FileManager& target) {
-    file->stream->open(this->namefile, std::ios::in | std::ios::binary);
-    if (!file->stream->is_open()) {
-        throw FileException(FileException::ErrorType::CopyError,
-                            "Failed to open source file: " + std::string(this->namefile));
-    }
-
-    target.file->stream->open(target.namefile, std::ios::out | std::ios::binary | std::ios::trunc);
-    if (!file->stream->is_open()) {
-        target.file->stream->open(target.namefile, std::ios::out | std::ios::binary | std::ios::trunc);
-    }
-    *target.file->stream << file->stream->rdbuf();
-    target.count = this->count;
-    target.file->stream->flush();
-    target.file->stream->close();
-    file->stream->flush();
-    file->stream->close();
+    Storage::get().copy(file->filename, target.file->filename);
+    target.file->stats->assign(*file->stats);
 }
 
 
 
+// Replace the contents with a host file; only this object and its own backing file are touched
+void FileManager::importFrom(const char* hostPath) {
+    validateReadStream();
+    file->stats->reset(Storage::get().importFile(hostPath, file->filename));
+}
+
+// Empty the file, dropping any blocks it still shares with copies
+void FileManager::clear() {
+    validateWriteStream();
+    Storage::get().remove(file->filename);
+    file->create();
+}
+
 // Remove file content
 void FileManager::remove(const char* filename) {
-    if (file->stream->is_open()) {
-        file->stream->close();
-    }
-    if(!file->stream->good()) return; //this is for if the file  not exist
-    if (std::remove(filename) != 0) {
-        throw FileException(FileException::ErrorType::DeleteError,
-                            "Failed to delete file: " + std::string(filename));
-    }
+    if (!file.operator->()) return; // already removed
+    if (!Storage::get().remove(filename)) return; //this is for if the file  not exist
     file = RCPtr<FileValue>(nullptr);
 }
 
 
 
 // Print file content
-void FileManager::cat(const char* filename) const {
-    file->stream->open(filename, std::ios::in);
-    if (!file->stream->is_open()) {
-        throw FileException(FileException::ErrorType::NotOpen,
-                            "File stream is not open.");
-    }
-    std::string line;
-    while (std::getline(*file->stream, line)) {
-        std::cout << line << std::endl;
-    }
-    file->stream->close();
+void FileManager::cat(std::ostream& out) const {
+    // Plain descriptor behind the stream: hand the whole file to the kernel in one go
+    int outFd = -1;
+    if (out.rdbuf() == consoleOut) {
+        out.flush();
+        std::fflush(stdout);
+        outFd = STDOUT_FILENO;
+    } else if (auto* block = dynamic_cast<OutputBuffer*>(out.rdbuf())) {
+        block->drain();  // keep the order of what was printed before
+        outFd = block->descriptor();
+    }
+    size_t sent = 0;
+    if (outFd >= 0 && Storage::get().sendTo(file->filename, outFd, sent)) {
+        char last = '\n';
+        if (sent > 0) file->read(static_cast<int>(sent - 1), &last, 1);
+        if (last != '\n') out << '\n';  // getline-style output always ends the last line
+        out.flush();
+        return;
+    }
+
+    // Otherwise copy through the stream in large blocks
+    char last = '\n';
+    Storage::get().scan(file->filename, [&](const char* data, size_t len) {
+        out.write(data, static_cast<std::streamsize>(len));
+        last = data[len - 1];
+    });
+    if (last != '\n') out << '\n';  // getline-style output always ends the last line
+    out.flush();
+}
+
+// Count lines, words and characters from the stats; a rescan does not hold the backend's lock,
+// so several threads may count at once
+WordCount FileManager::countWords() const {
+    validateReadStream();
+    return file->stats->counts(file->filename);
 }
 
 // Print word count, line count, and char count
-void FileManager::wc(const char* filename) const {
-    file->stream->open(filename, std::ios::in);
-    if (!file->stream->is_open()) {
-        throw FileException(FileException::ErrorType::NotOpen,
-                            "File stream is not open.");
-    }
-    std::string line;
-    int lineCount = 0, wordCount = 0, charCount = 0;
-    while (std::getline(*file->stream, line)) {
-        ++lineCount;
-        charCount += static_cast<int>(line.size());
-        std::istringstream iss(line);
-        std::string word;
-        while (iss >> word) {
-            ++wordCount;
-        }
-    }
-    std::cout << "Lines: " << lineCount
-              << ", Words: " << wordCount
-              << ", Characters: " << charCount << std::endl;
-    file->stream->close();
+void FileManager::wc(std::ostream& out) const {
+    out << countWords() << std::endl;
 }
 
 // Create symbolic link (shared pointer)- symmetry from the email of Ofer shir
@@ -119,34 +151,31 @@ void FileManager::ln(FileManager& target) {
     }
 
     target.file = this->file;
+    target.backingKey = backingKey;
     file->markUnshareable();
 }
 
 
+// Size from the stats shared by every link to the file
+int FileManager::getSize() const {
+    return file.operator->() ? static_cast<int>(file->stats->size()) : 0;
+}
+
 // Get the file name
-std::string FileManager::getFileName() const {
+const std::string& FileManager::getFileName() const {
     return namefile;
 }
 
-// Validate if the file stream is ready for reading
+// Validate if the file is ready for reading
 void FileManager::validateReadStream() const {
-    if (!file.operator->() || !file->stream) {
+    if (!file.operator->()) {
         throw FileException(FileException::ErrorType::ReadError,
                             "Invalid file stream.");
     }
-    file->stream->open(this->namefile, std::ios::in);
-    if (!file->stream->is_open()) {
-        throw FileException(FileException::ErrorType::ReadError,
-                            "Unable to open file stream for reading.");
-    }
 }
 
-// Validate if the file stream is ready for writing
+// Validate if the file is ready for writing
 void FileManager::validateWriteStream() {
-    if (file->stream->is_open()) {
-        file->stream->close();
-        file->stream->clear();
-    }
     if (!file.operator->()) {
         throw FileException(FileException::ErrorType::WriteError,
                             "Invalid file.");
@@ -155,17 +184,11 @@ void FileManager::validateWriteStream() {
         file = new FileValue(*file);
     }
     file->markUnshareable();
-    file->stream->clear();
-    file->stream->open(this->namefile, std::ios::in | std::ios::out);
-    if (!file->stream->is_open()) {
-        throw FileException(FileException::ErrorType::WriteError,
-                            "Unable to open file stream for writing.");
-    }
 }
 
 // Validate index bounds when accessing the file content
 void FileManager::validateIndex(int i) const {
-    if (i < 0 || i > count) {
+    if (i < 0 || i > getSize()) {
         throw FileException(FileException::ErrorType::ReadError,
                             "Index is out of bounds.");
     }
@@ -176,8 +199,8 @@ void FileManager::validateIndex(int i) const {
 FileManager& FileManager::operator=(const FileManager& other) {
     if (this != &other) {
         namefile = other.namefile;
-        count = other.count;
         file = other.file;
+        backingKey = other.backingKey;
     }
     return *this;
 }
@@ -4,31 +4,47 @@
 #include "RCPtr.h"
 #include "FileValue.h"
 #include "Proxy.h"
+#include "WordCount.h"
+#include <ostream>
+#include <string_view>
 
 // The FileManager class manages file operations using reference-counted pointers
 class FileManager {
     friend class Proxy; // Allow Proxy class to access private members
 private:
-    void validateReadStream() const; // Validate if the file stream is ready for reading
-    void validateWriteStream();      // Validate if the file stream is ready for writing
+    void validateReadStream() const; // Validate if the file is ready for reading
+    void validateWriteStream();      // Validate if the file is ready for writing
     void validateIndex(int i) const; // Validate index bounds when accessing the file content
     RCPtr<FileValue> file;            // Smart pointer to handle the file data
     std::string namefile;             // Name of the file
-    int count{};                      // Number of characters written to the file
+    std::size_t backingKey;           // Hash of file->filename; a write detaching the value keeps it
 public:
-    FileManager() : file(nullptr) {} // Default constructor initializing file to nullptr
+    FileManager() : file(nullptr), backingKey(0) {} // Default constructor initializing file to nullptr
     explicit FileManager(const char* filename); // Constructor that opens/creates a file
+    FileManager(const FileManager& other) = default; // Copy constructor (shares the file value)
+    FileManager(FileManager&& other) noexcept = default; // Move constructor (no reference count traffic)
     FileManager& operator=(const FileManager& other); // Copy assignment operator
+    FileManager& operator=(FileManager&& other) noexcept = default; // Move assignment operator
     Proxy operator[](int i) const; // Read-only access to a character via Proxy
     Proxy operator[](int i);       // Write access to a character via Proxy
+    std::string read(int offset, int length) const; // Read up to length bytes starting at offset
+    void write(int offset, std::string_view data); // Write data starting at offset (at most at the end)
+    void append(std::string_view data);            // Write data at the end of the file
     void touch(const char* filename); // Create a new empty file
     void copy(FileManager& target);   // Copy contents to another FileManager target
+    void importFrom(const char* hostPath); // Replace the contents with a host file (several files may import at once)
+    void clear();                     // Empty the file
     void remove(const char* filename); // Delete the specified file
-    void cat(const char* filename) const; // Print file contents to console
-    void wc(const char* filename) const;  // Print word count, line count, and char count
+    void cat(std::ostream& out) const; // Print file contents to out (sent by the kernel when out is a console or block buffer)
+    WordCount countWords() const; // Lines, words and characters, kept up to date by writes (safe from several threads at once)
+    void wc(std::ostream& out) const;  // Print word count, line count, and char count to out
     void ln(FileManager& target); // Create a symbolic link (share the file pointer)
-    std::string getFileName() const; // Get the file name
+    const std::string& getFileName() const; // Get the file name
+    std::size_t getBackingKey() const { return backingKey; } // Hash of the backing file's name, shared by every link to it
+    int getSize() const; // Number of characters in the file
     int getRefCount() const { return file->getRefCount(); } // Get current reference count
+    bool isShared() const { return file.operator->() && file->isShared(); } // Another file (ln) uses the same value
+    bool isShareable() const { return file.operator->() && file->isShareable(); } // No write went through the file yet (ln may still share it)
     ~FileManager() = default; // Default destructor
 };
 
@@ -0,0 +1,101 @@
+#include "FileStats.h"
+#include "Storage.h"
+#include <algorithm>
+#include <string>
+
+// Same set as isspace() in the "C" locale, as WordCount counts words
+static inline bool isSpace(char c) {
+    unsigned char u = static_cast<unsigned char>(c);
+    return u == ' ' || static_cast<unsigned char>(u - '\t') <= '\r' - '\t';
+}
+
+// Counts of the whole file, rescanned only when they cannot be trusted
+WordCount FileStats::counts(const std::string& path) {
+    std::lock_guard<std::mutex> g(lock);
+    Storage& storage = Storage::get();
+    std::uint64_t now = storage.stamp(path);
+    // A change made by the process is counted already; one made outside since then must at least
+    // have kept the size, which is all the stamp cannot tell apart
+    if (known && (now == stamp || (ours && storage.length(path) == length.load(std::memory_order_relaxed)))) {
+        stamp = now;
+        ours = false;
+        return total;
+    }
+    WordCount scanned;
+    storage.scan(path, [&](const char* data, std::size_t len) {
+        scanned.merge(WordCount::countParallel(data, len));
+    });
+    total = scanned;
+    known = true;
+    ours = false;
+    stamp = now;
+    length.store(scanned.bytes, std::memory_order_release);
+    return total;
+}
+
+// Replace the counts of the overwritten range [offset, offset + overlap) with those of the new bytes;
+// a word can join the byte before the range and the byte after it, so those are read as well
+void FileStats::update(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(lock);
+    ours = true;
+    std::size_t size = length.load(std::memory_order_relaxed);
+    std::size_t end = offset + len;
+    if (len == 0) return;
+    if (offset > size) known = false;  // the backend fills the gap, nobody counted it
+    if (known) {
+        WordCount added = WordCount::count(buf, len);
+        if (offset == size) {
+            total.merge(added);  // append: the end of the file is the write position
+        } else {
+            std::size_t overlap = std::min(len, size - offset);
+            bool hasBefore = offset > 0, hasAfter = end < size;
+            std::size_t first = offset - (hasBefore ? 1 : 0);
+            std::string old(overlap + (hasBefore ? 1 : 0) + (hasAfter ? 1 : 0), '\0');
+            std::size_t got = Storage::get().read(path, first, &old[0], old.size());
+            if (got != old.size()) {
+                known = false;  // shorter than counted, the next request rescans
+            } else {
+                WordCount removed = WordCount::count(old.data() + (hasBefore ? 1 : 0), overlap);
+                bool before = hasBefore && !isSpace(old.front());  // a word runs into the range from the left
+                bool after = hasAfter && !isSpace(old.back());     // and out of it to the right
+                std::size_t joinsRemoved = (before && removed.firstInWord) + (after && removed.lastInWord);
+                std::size_t joinsAdded = (before && added.firstInWord) + (after && added.lastInWord);
+                total.words = total.words + joinsRemoved + added.words - removed.words - joinsAdded;
+                total.newlines = total.newlines + added.newlines - removed.newlines;
+                total.bytes = std::max(size, end);
+                if (offset == 0) total.firstInWord = added.firstInWord;
+                if (end >= size) {
+                    total.lastInWord = added.lastInWord;
+                    total.last = added.last;
+                }
+            }
+        }
+    }
+    length.store(std::max(size, end), std::memory_order_release);
+}
+
+// Contents nobody counted, or an empty file
+void FileStats::reset(std::size_t size) {
+    std::lock_guard<std::mutex> g(lock);
+    total = WordCount();
+    known = size == 0;
+    ours = true;
+    length.store(size, std::memory_order_release);
+}
+
+// The next request rescans
+void FileStats::forget() {
+    std::lock_guard<std::mutex> g(lock);
+    known = false;
+}
+
+// The copy has the source's contents; copying may also have moved the source's blocks (CowStorage)
+void FileStats::assign(FileStats& source) {
+    if (&source == this) return;
+    std::scoped_lock g(lock, source.lock);
+    total = source.total;
+    known = source.known;
+    ours = true;
+    source.ours = true;
+    length.store(source.length.load(std::memory_order_relaxed), std::memory_order_release);
+}
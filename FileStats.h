@@ -0,0 +1,50 @@
+#ifndef EX1_FILE_STATS_H
+#define EX1_FILE_STATS_H
+
+#include "WordCount.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// FileStats class: size, line and word counts of one backing file, kept up to date by every write from the
+// bytes it replaces and the bytes around them, so wc and size checks do not read the file.
+// The counts are rescanned on the next request when nobody counted the contents (imported, or left on disk)
+// or when the backing file changed outside the process, as told by Storage::stamp(). An outside write that
+// keeps the size and lands between a write of the process and the next request goes unnoticed.
+class FileStats {
+public:
+    FileStats() : length(0), known(false), ours(true), stamp(0) {}
+    FileStats(const FileStats&) = delete;
+    FileStats& operator=(const FileStats&) = delete;
+
+    // Size of the file in bytes
+    std::size_t size() const { return length.load(std::memory_order_acquire); }
+
+    // Counts of the whole file; scans path only if they are not known or the file changed outside the process
+    WordCount counts(const std::string& path);
+
+    // Account for len bytes of buf about to be written at offset in path; must run before the write,
+    // it reads the bytes being replaced and their two neighbours (nothing at all for an append)
+    void update(const std::string& path, std::size_t offset, const char* buf, std::size_t len);
+
+    // The file now holds size bytes that were not counted (0: the file is empty and the counts are known)
+    void reset(std::size_t size);
+
+    // Drop the counts after a write that may have been cut short; the next request rescans
+    void forget();
+
+    // Take over the counts of source, whose contents were just copied into this file
+    void assign(FileStats& source);
+
+private:
+    std::mutex lock;                  // Guards everything but length, which is read without it
+    std::atomic<std::size_t> length;  // Bytes in the file
+    WordCount total;                  // Counts of the whole file, valid while known
+    bool known;                       // total matches the contents
+    bool ours;                        // The process changed the file since stamp was taken
+    std::uint64_t stamp;              // Storage::stamp() of the file when the counts were last handed out
+};
+
+#endif //EX1_FILE_STATS_H
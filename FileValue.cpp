@@ -1,39 +1,62 @@
-#include <iostream>
 #include "FileValue.h"
+#include "Storage.h"
 
-// Constructor: Opens the file for reading and writing, moves to the end of file
-FileValue::FileValue(const char* filename) : filename(filename) {
-    stream = new std::fstream(filename, std::ios::in | std::ios::out | std::ios::ate);
-}
-
-// Initialize the file stream for binary read/write mode
-void FileValue::init(const char* filname) {
-    stream = new std::fstream(filename, std::ios::in | std::ios::out | std::ios::binary);
-    this->filename = filname;
-}
+// Constructor: Only records the name, the backend opens the file on first use
+FileValue::FileValue(const char* filename) : filename(filename), stats(std::make_shared<FileStats>()) {}
 
-// Copy constructor: uses RCObject's copy and initializes the new stream
-FileValue::FileValue(const FileValue& rhs) : RCObject(rhs), stream(nullptr) {
-    init(rhs.filename);
-}
+// Copy constructor: uses RCObject's copy and refers to the same backing file
+FileValue::FileValue(const FileValue& rhs) : RCObject(rhs), filename(rhs.filename), stats(rhs.stats) {}
 
-// Assignment operator: properly handles resource management when copying
+// Assignment operator: rebinds to the other value's backing file
 FileValue& FileValue::operator=(const FileValue& rhs) {
     if (this != &rhs) {
-        if (stream) {
-            stream->close();
-            delete stream;
-        }
-        init(rhs.filename);
+        filename = rhs.filename;
+        stats = rhs.stats;
     }
     return *this;
 }
 
-// Destructor: closes and deletes the file stream
-FileValue::~FileValue() {
-    if (stream) {
-        stream->close();
-        delete stream;
-        stream = nullptr;
+// Destructor: nothing to release, other values may still use the same backing file
+FileValue::~FileValue() = default;
+
+// Create the backing file if it does not exist yet
+void FileValue::create() const {
+    Storage::get().create(filename);
+    stats->reset(Storage::get().length(filename));
+}
+
+// Read the character at the given index
+char FileValue::get(int index) const {
+    char c;
+    if (Storage::get().read(filename, index, &c, 1) != 1) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to read from file: " + filename);
+    }
+    return c;
+}
+
+// Write a character at the given index
+void FileValue::put(int index, char c) {
+    write(index, &c, 1);
+}
+
+// Read up to len bytes at offset into buf
+int FileValue::read(int offset, char* buf, int len) const {
+    return static_cast<int>(Storage::get().read(filename, offset, buf, len));
+}
+
+// Write len bytes from buf at offset, counting them first
+void FileValue::write(int offset, const char* buf, int len) {
+    stats->update(filename, static_cast<std::size_t>(offset), buf, static_cast<std::size_t>(len));
+    try {
+        Storage::get().write(filename, offset, buf, len);
+    } catch (...) {
+        stats->forget();
+        throw;
     }
 }
+
+// Delete the backing file
+bool FileValue::remove() const {
+    return Storage::get().remove(filename);
+}
@@ -4,13 +4,17 @@
 #include "RCObject.h"
 #include "FileException.h"
 #include "Proxy.h"
-#include <fstream>
+#include "FileStats.h"
+#include <memory>
 #include <string>
 
-// FileValue class: Manages a file stream with reference counting via RCObject
-class FileValue : public RCObject {
+// FileValue class: Manages a backing file with reference counting via RCObject.
+// The bytes are held by the process-wide Storage backend, keyed by the file name.
+// The count is atomic, so values may be shared and released from worker threads.
+// Values bound to the same backing file share one FileStats, which every write keeps up to date.
+class FileValue : public RCObject<AtomicCount> {
 public:
-    // Constructor: Opens a file for reading and writing
+    // Constructor: Binds the value to a backing file (the file is opened lazily)
     explicit FileValue(const char* filename);
 
     // Copy constructor: Initializes a new FileValue from another
@@ -19,18 +23,32 @@ public:
     // Assignment operator: Handles copying and cleanup
     FileValue& operator=(const FileValue& rhs);
 
-    // Destructor: Cleans up the file stream
+    // Destructor: Open descriptors and mappings are left to the backend's close policy
     ~FileValue() override;
 
-    // Pointer to the file stream
-    std::fstream* stream;
+    // Create the backing file if it does not exist yet; its current length is taken over as uncounted
+    void create() const;
 
-    // Pointer to the filename
-    const char* filename{};
+    // Read the character at the given index
+    char get(int index) const;
 
-private:
-    // Helper function to initialize the file stream
-    void init(const char* filename);
+    // Write a character at the given index
+    void put(int index, char c);
+
+    // Read up to len bytes at offset into buf; returns the number of bytes read
+    int read(int offset, char* buf, int len) const;
+
+    // Write len bytes from buf at offset
+    void write(int offset, const char* buf, int len);
+
+    // Delete the backing file; returns false if it did not exist
+    bool remove() const;
+
+    // Name of the backing file
+    std::string filename;
+
+    // Size and counts of the backing file
+    std::shared_ptr<FileStats> stats;
 };
 
 #endif //EX1_FILE_VALUE_H
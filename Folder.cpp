@@ -1,259 +1,440 @@
 #include "Folder.h"
+#include "Snapshot.h"
+#include "Reaper.h"
+#include "FolderWalk.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <sstream>
-#include <functional>
+#include <mutex>
 
-// Global current working directory pointer
-static Folder* current = nullptr;
+// Serializes reading folders from snapshots, which sessions do while holding the structure lock shared
+static std::mutex loadLock;
 
-// Utility to split a string by a delimiter
-static std::vector<std::string> splitInternal(const std::string& s, char delim = '#') {
-    std::vector<std::string> parts;
-    std::string token;
-    std::istringstream iss(s);
-    while (std::getline(iss, token, delim)) {
-        if (!token.empty()) parts.push_back(token);
+// Folders of any tree whose children have not been read yet; while there are some, getFile takes loadLock
+static std::atomic<std::size_t> unloadedFolders(0);
+
+// Folder constructor
+Folder::Folder(std::string name)
+        : foldername(std::move(name)), parent(nullptr), structure(nullptr), record(0), unloaded(false) {}
+
+// Start the folder from a snapshot record
+void Folder::attach(std::shared_ptr<const Snapshot> snapshot, std::uint64_t rec) {
+    source = std::move(snapshot);
+    record = rec;
+    ++unloadedFolders;
+    unloaded.store(true, std::memory_order_release);
+}
+
+// Double-checked: once read, a folder costs one atomic load per visit
+void Folder::load() const {
+    if (!unloaded.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> g(loadLock);
+    if (!unloaded.load(std::memory_order_relaxed)) return;
+    Folder* self = const_cast<Folder*>(this);  // reading in the children does not change the tree anyone sees
+    auto done = [self] {
+        self->source.reset();
+        --unloadedFolders;
+        self->unloaded.store(false, std::memory_order_release);
+    };
+    try {
+        self->materialize();
+    } catch (...) {
+        done();  // keep what was read, a damaged record is not retried
+        throw;
     }
-    return parts;
+    done();
 }
 
-// Folder constructor
-Folder::Folder(const char* name)
-        : foldername(name ? name : ""), parent(nullptr) {
-    // Initialize current to root on first construction
-    if (!current) current = this;
+// Subfolders only remember their record; files are created and filled right away
+void Folder::materialize() {
+    const Snapshot& snap = *source;
+    const Snapshot::FolderRecord& rec = snap.folder(record);
+    for (std::uint64_t i = 0; i < rec.folders; ++i) {
+        const Snapshot::FolderRecord& sub = snap.folder(rec.firstFolder + i);
+        subfolders.emplace_back(std::string(snap.name(sub.name, sub.nameLength)));
+        Folder* child = &subfolders.back();
+        child->parent = this;
+        subfolderIndex[child->foldername] = std::prev(subfolders.end());
+        if (sub.folders > 0 || sub.files > 0) child->attach(source, rec.firstFolder + i);
+    }
+    if (rec.files == 0) return;  // finding the path and the root costs a walk up a possibly deep tree
+    std::string prefix = internalPrefix();
+    Folder* root = this;
+    while (root->parent) root = root->parent;
+    for (std::uint64_t i = 0; i < rec.files; ++i) {
+        const Snapshot::FileRecord& fr = snap.file(rec.firstFile + i);
+        std::string name = prefix + std::string(snap.name(fr.name, fr.nameLength));
+        files.emplace_back(name.c_str());
+        FileManager& fm = files.back();
+        fileNames[Path::leaf(fm.getFileName())] = std::prev(files.end());
+        root->fileIndex[fm.getFileName()] = &fm;
+        fm.touch(name.c_str());
+        fm.clear();  // also drops what a crashed run left in the backing file
+        fm.write(0, snap.data(fr));
+    }
 }
-// Folder destructor
-Folder::~Folder() {
-    // Recursively remove all files on disk and clear subfolders
-    std::function<void(Folder*)> clearAll = [&](Folder* f) {
-        for (auto& fm : f->files) {
-            fm.remove(fm.getFileName().c_str());
+
+// Find a direct subfolder by name
+Folder* Folder::findSubfolder(std::string_view name) {
+    load();
+    auto it = subfolderIndex.find(name);
+    return it == subfolderIndex.end() ? nullptr : &*it->second;
+}
+
+// Find a direct subfolder by name
+const Folder* Folder::findSubfolder(std::string_view name) const {
+    load();
+    auto it = subfolderIndex.find(name);
+    return it == subfolderIndex.end() ? nullptr : &*it->second;
+}
+
+// Walk the first count components of path, from this folder if the path starts with its name, else from cwd
+Folder* Folder::walk(const Path& path, size_t count, Folder* cwd, size_t* missing) {
+    size_t i = 0;
+    Folder* node = cwd;
+    if (!path.empty() && path[0] == foldername) {
+        node = this;
+        i = 1;
+    }
+    for (; i < count; ++i) {
+        if (path[i] == "..") {
+            if (node->parent) node = node->parent;
+            continue;
         }
-        for (auto& sf : f->subfolders) {
-            clearAll(&sf);
+        Folder* next = node->findSubfolder(path[i]);
+        if (!next) {
+            if (missing) *missing = i;
+            return nullptr;
         }
-        f->files.clear();
-        f->subfolders.clear();
-    };
-    clearAll(this);
-    if (current == this) current = nullptr;
+        node = next;
+    }
+    node->load();
+    return node;
+}
+
+// Walk the first count components of path without modifying anything
+const Folder* Folder::walk(const Path& path, size_t count, const Folder* cwd, size_t* missing) const {
+    return const_cast<Folder*>(this)->walk(path, count, const_cast<Folder*>(cwd), missing);
 }
+
+// Register a session working in the tree
+void Folder::attachSession(Session& session) {
+    sessions.push_back(&session);
+}
+
+// Forget a session that ended
+void Folder::detachSession(Session& session) {
+    sessions.erase(std::remove(sessions.begin(), sessions.end(), &session), sessions.end());
+}
+
+// Drop every file below node from the root's index; folders not read from a snapshot yet have no files.
+// A value shared by ln is still reachable through the alias, so it is removed now, as removeFile would:
+// left to the reaper, whether the alias finds its backing file would depend on when the thread gets there
+std::size_t Folder::unindexTree(Folder* node) {
+    std::size_t count = 0;
+    FolderWalk<Folder> walk(FolderWalk<Folder>::DepthFirst, SIZE_MAX, false);
+    walk.start(*node);
+    while (Folder* f = walk.next()) {
+        for (auto it = f->files.begin(); it != f->files.end();) {
+            fileIndex.erase(it->getFileName());
+            if (!it->isShared()) {
+                ++count;
+                ++it;
+                continue;
+            }
+            f->fileNames.erase(Path::leaf(it->getFileName()));
+            it->remove(it->getFileName().c_str());
+            it = f->files.erase(it);
+        }
+    }
+    return count;
+}
+
+// Folder names joined from the root down
+std::string Folder::internalPrefix() const {
+    std::string prefix;
+    for (const Folder* f = this; f; f = f->parent) prefix.insert(0, f->foldername + '#');
+    return prefix;
+}
+
+// Folder destructor
+Folder::~Folder() {
+    if (unloaded.load(std::memory_order_relaxed)) --unloadedFolders;  // nothing of it was ever created
+    for (auto& fm : files) fm.remove(fm.getFileName().c_str());
+    // Take the subtree apart one folder at a time: each one is destroyed after its subfolders moved to the
+    // end of the list, so it only removes its own files and a deep tree does not recurse
+    FolderList doomed;
+    doomed.splice(doomed.end(), subfolders);
+    while (!doomed.empty()) {
+        doomed.splice(doomed.end(), doomed.front().subfolders);
+        doomed.pop_front();
+    }
+}
+
 // Create a new folder
-void Folder::mkdir(const char* name) {
-    if (!name || std::string(name).empty()) {
-        std::cerr << "mkdir: missing folder name" << std::endl;
+void Folder::mkdir(const Path& path, Session& session) {
+    if (path.empty()) {
+        session.err << "mkdir: missing folder name" << std::endl;
         return;
     }
-    auto path = splitInternal(name, '/');
-    Folder* node = path.empty() || path[0] != foldername ? current : this;
-    if (!path.empty() && path[0] == foldername) path.erase(path.begin());
-    for (size_t i = 0; i < path.size(); ++i) {
-        const auto& part = path[i];
-        auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                               [&](const Folder& f) { return f.foldername == part; });
-        if (it == node->subfolders.end()) {
-            if (i + 1 < path.size()) {
-                std::cerr << "mkdir: cannot create folder '" << part
-                          << "' because parent folder does not exist" << std::endl;
-                return;
-            }
-            node->subfolders.emplace_back(part.c_str());
-            node->subfolders.back().parent = node;
-            node = &node->subfolders.back();
-        } else {
-            if (i + 1 == path.size()) {
-                std::cerr << "mkdir: folder '" << part
-                          << "' already exists at thiscout level" << std::endl;
-                return;
-            }
-            node = &*it;
-        }
+    size_t missing = 0;
+    Folder* node = walk(path, path.size(), session.cwd, &missing);
+    if (node) {
+        session.err << "mkdir: folder '" << path.back()
+                    << "' already exists at thiscout level" << std::endl;
+        return;
     }
+    if (missing + 1 < path.size()) {
+        session.err << "mkdir: cannot create folder '" << path[missing]
+                    << "' because parent folder does not exist" << std::endl;
+        return;
+    }
+    node = walk(path, missing, session.cwd);
+    node->subfolders.emplace_back(std::string(path.back()));
+    Folder* created = &node->subfolders.back();
+    created->parent = node;
+    node->subfolderIndex[created->foldername] = std::prev(node->subfolders.end());
 }
 // Change current working directory
-void Folder::chdir(const char* name) {
-    if (!name || std::string(name).empty()) {
-        std::cerr << "chdir: missing folder name" << std::endl;
+void Folder::chdir(const Path& path, Session& session) {
+    if (path.empty()) {
+        session.err << "chdir: missing folder name" << std::endl;
         return;
     }
-    auto path = splitInternal(name, '/');
-    Folder* node = path.empty() || path[0] != foldername ? current : this;
-    if (!path.empty() && path[0] == foldername) path.erase(path.begin());
-    for (const auto& part : path) {
-        if (part == "..") {
-            if (node->parent) node = node->parent;
-        } else {
-            auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                                   [&](const Folder& f) { return f.foldername == part; });
-            if (it == node->subfolders.end()) {
-                std::cerr << "folder '" << part << "' not found" << std::endl;
-                return;
-            }
-            node = &*it;
-        }
+    size_t missing = 0;
+    Folder* node = walk(path, path.size(), session.cwd, &missing);
+    if (!node) {
+        session.err << "folder '" << path[missing] << "' not found" << std::endl;
+        return;
     }
-    current = node;
+    session.cwd = node;
 }
 // Remove a folder
-void Folder::rmdir(const char* name) {
-    if (!name || std::string(name).empty()) {
-        std::cerr<< "folder name is empty" << std::endl;
+void Folder::rmdir(const Path& path, Session& session) {
+    if (path.empty()) {
+        session.err << "folder name is empty" << std::endl;
         return;
     }
-    auto path = splitInternal(name, '/');
-    Folder* node = path.empty() || path[0] != foldername ? current : this;
-    if (!path.empty() && path[0] == foldername) path.erase(path.begin());
-    for (const auto& part : path) {
-        auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                               [&](const Folder& f) { return f.foldername == part; });
-        if (it == node->subfolders.end()) {
-            std::cerr << "folder '" << part << "' not found" << std::endl;
-            return;
-        }
-        node = &*it;
+    size_t missing = 0;
+    Folder* node = walk(path, path.size(), session.cwd, &missing);
+    if (!node) {
+        session.err << "folder '" << path[missing] << "' not found" << std::endl;
+        return;
     }
-    if (node == current && !node->parent) {
-        std::cerr << "cannot remove root folder" << std::endl;
+    if (!node->parent) {
+        session.err << "cannot remove root folder" << std::endl;
         return;
     }
-    // Recursively remove all files and subfolders
-    std::function<void(Folder*)> clearAll = [&](Folder* f) {
-        for (auto& fm : f->files) fm.remove(fm.getFileName().c_str());
-        for (auto& sf : f->subfolders) clearAll(&sf);
-        f->files.clear();
-        f->subfolders.clear();
-    };
-    clearAll(node);
-    if (current == node && node->parent) current = node->parent;
+    // Sessions standing in the folder or below it move to its parent
+    for (Session* s : sessions) {
+        for (const Folder* f = s->cwd; f; f = f->parent) {
+            if (f == node) {
+                s->cwd = node->parent;
+                break;
+            }
+        }
+    }
+    // Cut the folder out of the tree; the reaper removes its files and frees it in the background
+    std::size_t count = unindexTree(node);
+    std::string prefix = node->internalPrefix();
     auto parentPtr = node->parent;
-    parentPtr->subfolders.erase(
-            std::remove_if(parentPtr->subfolders.begin(), parentPtr->subfolders.end(),
-                           [&](const Folder& f) { return f.foldername == node->foldername; }),
-            parentPtr->subfolders.end());
+    auto pos = parentPtr->subfolderIndex.find(node->foldername);
+    auto slot = pos->second;
+    parentPtr->subfolderIndex.erase(pos);
+    node->parent = nullptr;
+    Reaper::instance().submit(parentPtr->subfolders, slot, std::move(prefix), count, *structure);
 }
 
 // show folder contents
-void Folder::ls(const char* name) const {
-    const Folder* node = name && splitInternal(name, '/')[0] == foldername ? this : current;
-    if (name && !std::string(name).empty()) {
-        auto path = splitInternal(name, '/');
-        if (path[0] == foldername) path.erase(path.begin());
-        for (const auto& part : path) {
-            auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                                   [&](const Folder& f) { return f.foldername == part; });
-            if (it == node->subfolders.end()) {
-                std::cerr << "folder '" << part << "' not found" << std::endl;
-                return;
-            }
-            node = &*it;
+void Folder::ls(const Path& path, const Session& session) const {
+    size_t missing = 0;
+    const Folder* node = walk(path, path.size(), session.cwd, &missing);
+    if (!node) {
+        session.err << "folder '" << path[missing] << "' not found" << std::endl;
+        return;
+    }
+    std::ostream& out = session.out;
+    std::vector<const Folder*> full;
+    for (const Folder* tmp = node; tmp; tmp = tmp->parent) full.push_back(tmp);
+    for (auto it = full.rbegin(); it != full.rend(); ++it) out << (*it)->foldername << "/";
+    out << std::endl;
+    for (const auto& sf : node->subfolders) out << sf.foldername << "/" << std::endl;
+    for (const auto& fm : node->files) out << Path::leaf(fm.getFileName()) << std::endl;
+}
+
+// Indentation for lproot lines, written in pieces of this size
+static const char SPACES[] = "                                                                ";
+
+// Write n spaces without building a string
+static void indent(std::ostream& out, std::size_t n) {
+    const std::size_t piece = sizeof SPACES - 1;
+    for (; n > piece; n -= piece) out.write(SPACES, static_cast<std::streamsize>(piece));
+    out.write(SPACES, static_cast<std::streamsize>(n));
+}
+
+// Folder tree starting from root, streamed line by line in depth-first order
+void Folder::lproot(std::ostream& out, std::size_t maxDepth) const {
+    FolderWalk<const Folder> walk(FolderWalk<const Folder>::DepthFirst, maxDepth);
+    walk.start(*this);
+    while (const Folder* f = walk.next()) {
+        std::size_t depth = walk.depth() * 4;
+        indent(out, depth);
+        out << f->foldername << "/\n";
+        for (const auto& fm : f->files) {
+            indent(out, depth + 4);
+            out << Path::leaf(fm.getFileName()) << ' ' << fm.getRefCount() << '\n';
         }
     }
-    std::vector<std::string> full;
-    for (const Folder* tmp = node; tmp; tmp = tmp->parent) full.push_back(tmp->foldername);
-    std::reverse(full.begin(), full.end());
-    for (const auto& p : full) std::cout << p << "/";
-    std::cout << std::endl;
-    for (const auto& sf : node->subfolders) std::cout << sf.foldername << "/" << std::endl;
-    for (const auto& fm : node->files) {
-        auto parts = splitInternal(fm.getFileName(), '#');
-        std::cout << parts.back() << "std::endl";
+    out.flush();
+}
+
+// Collect every file below a folder, in the order lproot prints them
+void Folder::collectFiles(const Path& path, const Session& session, std::vector<const FileManager*>& out) const {
+    size_t missing = 0;
+    const Folder* node = walk(path, path.size(), session.cwd, &missing);
+    if (!node) {
+        session.err << "folder '" << path[missing] << "' not found" << std::endl;
+        return;
+    }
+    FolderWalk<const Folder> walk;
+    walk.start(*node);
+    while (const Folder* f = walk.next()) {
+        for (const auto& fm : f->files) out.push_back(&fm);
     }
 }
 
-//folder tree starting from root
-void Folder::lproot() const {
-    std::function<void(const Folder*, int)> printTree;
-    printTree = [&](const Folder* f, int indent) {
-        std::cout << std::string(indent, ' ') << f->foldername << "/" << std::endl;
+// List the tree depth first; the relative path of the folder at each depth is cut back to its parent's
+void Folder::listTree(std::vector<std::string>& dirs, std::vector<std::string>& filePaths,
+                      std::vector<const FileManager*>& files) const {
+    std::string prefix;
+    std::vector<std::size_t> lengths{0};  // prefix length of the folder last visited at each depth
+    FolderWalk<const Folder> walk;
+    walk.start(*this);
+    while (const Folder* f = walk.next()) {
+        std::size_t depth = walk.depth();
+        if (depth > 0) {
+            prefix.resize(lengths[depth - 1]);
+            dirs.push_back(prefix + f->foldername);
+            prefix.append(f->foldername).push_back('/');
+            if (lengths.size() <= depth) lengths.resize(depth + 1);
+            lengths[depth] = prefix.size();
+        }
         for (const auto& fm : f->files) {
-            auto parts = splitInternal(fm.getFileName(), '#');
-            int refc = fm.getRefCount();
-            std::cout << std::string(indent + 4, ' ') << parts.back() << " " << refc <<std::endl;
+            filePaths.push_back(prefix + std::string(Path::leaf(fm.getFileName())));
+            files.push_back(&fm);
         }
-        for (const auto& sf : f->subfolders) printTree(&sf, indent + 4);
-    };
-    printTree(this, 0);
+    }
 }
 
-// Print current working directory path
-void Folder::pwd() {
-    std::vector<std::string> parts;
-    for (const Folder* tmp = current; tmp; tmp = tmp->parent) parts.push_back(tmp->foldername);
-    for (auto it = parts.rbegin(); it != parts.rend(); ++it) std::cout << *it << "/";
-    std::cout << std::endl;
+// Print the session's current working directory path
+void Folder::pwd(const Session& session) {
+    std::vector<const Folder*> parts;
+    for (const Folder* tmp = session.cwd; tmp; tmp = tmp->parent) parts.push_back(tmp);
+    for (auto it = parts.rbegin(); it != parts.rend(); ++it) session.out << (*it)->foldername << "/";
+    session.out << std::endl;
 }
 
 // Add a file into the folder
-void Folder::addFile(const FileManager& fm) {
-    auto parts = splitInternal(fm.getFileName(), '#');
-    if (parts.size() < 2) { std::cerr << "invalid file path" << std::endl; return; }
-    parts.pop_back();
-    Folder* node = parts[0] == foldername ? this : current;
-    if (!parts.empty() && parts[0] == foldername) parts.erase(parts.begin());
-    for (const auto& part : parts) {
-        auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                               [&](const Folder& f) { return f.foldername == part; });
-        if (it == node->subfolders.end()) { std::cerr << "folder '" << part << "' not found" <<std::endl; return; }
-        node = &*it;
-    }
-    node->files.emplace_back(fm);
-
+void Folder::addFile(const Path& path, FileManager fm, Session& session) {
+    if (path.size() < 2) { session.err << "invalid file path" << std::endl; return; }
+    size_t missing = 0;
+    Folder* node = walk(path, path.size() - 1, session.cwd, &missing);
+    if (!node) { session.err << "folder '" << path[missing] << "' not found" <<std::endl; return; }
+    if (node->fileNames.count(path.back())) return; // already exists, touch keeps the current contents
+    node->files.emplace_back(std::move(fm));
+    const FileManager& added = node->files.back();
+    node->fileNames[Path::leaf(added.getFileName())] = std::prev(node->files.end());
+    fileIndex[added.getFileName()] = &node->files.back();
 }
 
-// Get a pointer to a file by name
-FileManager* Folder::getFile(const std::string& name) {
-    auto it = std::find_if(files.begin(), files.end(),
-                           [&](const FileManager& fm) { return fm.getFileName() == name; });
-    if (it != files.end()) {
-        return &(*it);
+// Mirror a tree below an existing folder, resolving each parent from the folders already made
+bool Folder::addTree(const Path& dest, const std::vector<std::string>& dirs,
+                     const std::vector<std::string>& files, std::vector<FileManager*>& added, Session& session) {
+    size_t missing = 0;
+    Folder* base = walk(dest, dest.size(), session.cwd, &missing);
+    if (!base) {
+        session.err << "folder '" << dest[missing] << "' not found" << std::endl;
+        return false;
     }
+    std::unordered_map<std::string_view, Folder*> made;  // relative folder path -> node
+    made.reserve(dirs.size() + 1);
+    made[std::string_view()] = base;
+    // Parent node of a relative path (nullptr if it was skipped), with the path's last component in leaf
+    auto parentOf = [&made](std::string_view rel, std::string_view& leaf) -> Folder* {
+        size_t slash = rel.rfind('/');
+        leaf = slash == std::string_view::npos ? rel : rel.substr(slash + 1);
+        auto it = made.find(slash == std::string_view::npos ? std::string_view() : rel.substr(0, slash));
+        return it == made.end() ? nullptr : it->second;
+    };
 
-    for (auto& sub : subfolders) {
-        FileManager* found = sub.getFile(name);
-        if (found != nullptr) {
-            return found;
+    for (const auto& rel : dirs) {
+        std::string_view leaf;
+        Folder* node = parentOf(rel, leaf);
+        if (!node) continue;
+        Folder* sub = node->findSubfolder(leaf);
+        if (!sub) {
+            node->subfolders.emplace_back(std::string(leaf));
+            sub = &node->subfolders.back();
+            sub->parent = node;
+            node->subfolderIndex[sub->foldername] = std::prev(node->subfolders.end());
         }
+        made[rel] = sub;
     }
-    return nullptr;
-}
 
-// Remove a file given its full path
-void Folder::removeFile(const std::string& fullPath) {
-    auto parts = splitInternal(fullPath, '#');
-    if (parts.size() < 2) { std::cerr << "invalid file path" << std::endl; return; }
-    parts.pop_back();
-    Folder* node = parts.empty() || parts[0] != foldername ? current : this;
-    if (!parts.empty() && parts[0] == foldername) parts.erase(parts.begin());
-    for (const auto& part : parts) {
-        auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                               [&](const Folder& f) { return f.foldername == part; });
-        if (it == node->subfolders.end()) { std::cerr << "folder '" << part << "' not found" << std::endl; return; }
-        node = &*it;
+    std::string prefix;
+    for (size_t i = 0; i < dest.size(); ++i) prefix.append(dest[i]).push_back('#');
+    added.clear();
+    added.reserve(files.size());
+    for (const auto& rel : files) {
+        std::string_view leaf;
+        Folder* node = parentOf(rel, leaf);
+        if (!node) { added.push_back(nullptr); continue; }
+        auto itf = node->fileNames.find(leaf);
+        if (itf != node->fileNames.end()) { added.push_back(&*itf->second); continue; }
+        std::string name = prefix + rel;
+        std::replace(name.begin() + static_cast<std::ptrdiff_t>(prefix.size()), name.end(), '/', '#');
+        node->files.emplace_back(name.c_str());
+        FileManager& fm = node->files.back();
+        node->fileNames[Path::leaf(fm.getFileName())] = std::prev(node->files.end());
+        fileIndex[fm.getFileName()] = &fm;
+        added.push_back(&fm);
     }
-    auto itf = std::find_if(node->files.begin(), node->files.end(),
-                            [&](const FileManager& fm) { return fm.getFileName() == fullPath; });
-    if (itf == node->files.end()) { std::cerr << "file '" << fullPath << "' not found" << std::endl; return; }
-    itf->remove(fullPath.c_str());
-    node->files.erase(itf);
+    return true;
 }
 
-//check if folder Exist
-bool Folder::folderExists(const std::string& fullPath) const {
-    auto parts = splitInternal(fullPath, '#');
-    if (parts.size() < 2) return false;
-    parts.pop_back();
-    const Folder* node = (parts[0] == foldername ? this : current);
-    if (parts[0] == foldername) parts.erase(parts.begin());
+// Get a pointer to a file by its full internal path
+FileManager* Folder::getFile(const Path& path) {
+    if (unloadedFolders.load(std::memory_order_acquire) > 0) {
+        // Read the folders on the way from the snapshot; other sessions may be adding to the index meanwhile
+        if (path.size() > 1) walk(path, path.size() - 1, this);
+        std::lock_guard<std::mutex> g(loadLock);
+        auto it = fileIndex.find(path.internal());
+        return it == fileIndex.end() ? nullptr : it->second;
+    }
+    auto it = fileIndex.find(path.internal());
+    return it == fileIndex.end() ? nullptr : it->second;
+}
 
-    for (const auto& part : parts) {
-        auto it = std::find_if(node->subfolders.begin(), node->subfolders.end(),
-                               [&](const Folder& f) { return f.foldername == part; });
-        if (it == node->subfolders.end())
-            return false;
-        node = &*it;
+// Remove a file given its full path
+void Folder::removeFile(const Path& path, Session& session) {
+    if (path.size() < 2) { session.err << "invalid file path" << std::endl; return; }
+    size_t missing = 0;
+    Folder* node = walk(path, path.size() - 1, session.cwd, &missing);
+    if (!node) { session.err << "folder '" << path[missing] << "' not found" << std::endl; return; }
+    auto itf = node->fileNames.find(path.back());
+    if (itf == node->fileNames.end() || itf->second->getFileName() != path.internal()) {
+        session.err << "file '" << path.internal() << "' not found" << std::endl;
+        return;
     }
-    return true;
+    auto slot = itf->second;
+    fileIndex.erase(slot->getFileName());
+    node->fileNames.erase(itf);
+    slot->remove(path.internal().c_str());
+    node->files.erase(slot);
 }
 
+//check if folder Exist
+bool Folder::folderExists(const Path& path, const Session& session) const {
+    if (path.size() < 2) return false;
+    return walk(path, path.size() - 1, session.cwd) != nullptr;
+}
@@ -1,51 +1,143 @@
 #ifndef EX1_FOLDER_H
 #define EX1_FOLDER_H
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include "FileManager.h"
+#include "NodePool.h"
+#include "Path.h"
+
+class Folder;
+class Snapshot;
+
+// Session struct: what a Folder operation needs from the Terminal session running it.
+// Relative paths start at cwd, listings go to out and messages to err
+struct Session {
+    Folder* cwd;        // Current working directory of the session
+    std::ostream& out;  // Standard output of the session
+    std::ostream& err;  // Error output of the session
+};
 
 // Folder class represents a directory structure in the file system.
+// A folder started from a snapshot reads its children from it the first time anything looks inside it.
 class Folder {
+    friend class Snapshot;
+    friend class Reaper;
+    template<class> friend class FolderWalk;
 private:
     std::string foldername;  // The name of the folder
     Folder* parent;  // Pointer to the parent folder (nullptr if this is the root)
-    std::vector<Folder> subfolders;  // List of subfolders contained within this folder
-    std::vector<FileManager> files;  // List of files contained within this folder
+    // Child nodes come from process-wide node pools, so they never move and never get copied
+    typedef std::list<Folder, NodeAllocator<Folder>> FolderList;
+    typedef std::list<FileManager, NodeAllocator<FileManager>> FileList;
+    // Keys view the child's own name, so lookups by a Path component never allocate
+    template<class V>
+    using NameIndex = std::unordered_map<std::string_view, V, std::hash<std::string_view>,
+                                         std::equal_to<std::string_view>,
+                                         NodeAllocator<std::pair<const std::string_view, V>>>;
+
+    FolderList subfolders;  // List of subfolders contained within this folder, in creation order
+    NameIndex<FolderList::iterator> subfolderIndex;  // Subfolder name -> entry
+    FileList files;  // List of files contained within this folder, in creation order
+    NameIndex<FileList::iterator> fileNames;  // File name -> entry
+    NameIndex<FileManager*> fileIndex;  // Full internal path -> file, kept on the root only
+    std::vector<Session*> sessions;  // Sessions working in the tree, kept on the root only
+    std::shared_mutex* structure;    // Lock the reaper frees removed folders under, kept on the root only
+    std::shared_ptr<const Snapshot> source;  // Snapshot the children are still to be read from
+    std::uint64_t record;                    // Folder record of this folder in source
+    mutable std::atomic<bool> unloaded;      // Set while the children have not been read from source
+
+    // Read the children from the snapshot the first time; safe under the shared structure lock
+    void load() const;
+
+    // Create the children listed in the folder's snapshot record, with their contents
+    void materialize();
+
+    // Find a direct subfolder by name (nullptr if missing)
+    Folder* findSubfolder(std::string_view name);
+    const Folder* findSubfolder(std::string_view name) const;
+
+    // Resolve the first count components of path, relative ones from cwd; on failure returns nullptr
+    // and sets *missing to the index of the first component that does not exist
+    Folder* walk(const Path& path, size_t count, Folder* cwd, size_t* missing = nullptr);
+    const Folder* walk(const Path& path, size_t count, const Folder* cwd, size_t* missing = nullptr) const;
+
+    // Drop every file below node from the root's index and remove the ones an ln alias shares right away;
+    // returns how many are left for the reaper
+    std::size_t unindexTree(Folder* node);
+
+    // Internal path of the folder with a trailing separator, e.g. "V#tmp#"
+    std::string internalPrefix() const;
 public:
     // Constructor initializes a folder with a given name
-    explicit Folder(const char* name);
+    explicit Folder(std::string name);
+
+    // Folders own their files on disk and are referenced by address, so they are never copied or moved
+    Folder(const Folder&) = delete;
+    Folder& operator=(const Folder&) = delete;
+
+    // Method to start the folder from a snapshot record; its children are read when first used
+    void attach(std::shared_ptr<const Snapshot> snapshot, std::uint64_t rec);
+
+    // Method to give rmdir the tree's structure lock, which the reaper needs to free removed folders
+    void setStructureLock(std::shared_mutex& lock) { structure = &lock; }
+
+    // Methods to register a session so rmdir can move it out of a removed folder, and to drop it again
+    void attachSession(Session& session);
+    void detachSession(Session& session);
 
     // Method to create a new folder within the current folder
-    void mkdir(const char* foldername);
+    void mkdir(const Path& path, Session& session);
 
-    // Method to change the current folder to the specified folder
-    void chdir(const char* foldername);
+    // Method to change the session's current folder to the specified folder
+    void chdir(const Path& path, Session& session);
 
-    // Method to remove a folder by its name
-    void rmdir(const char* foldername);
+    // Method to remove a folder by its name; sessions inside it move to its parent
+    void rmdir(const Path& path, Session& session);
 
     // Method to list all subfolders and files in the current folder
-    void ls(const char* foldername) const;
+    void ls(const Path& path, const Session& session) const;
+
+    // Method to display the structure of the entire file system from the root, down to maxDepth levels below it
+    void lproot(std::ostream& out, std::size_t maxDepth = SIZE_MAX) const;
+
+    // Static method to display the session's current working directory (PWD)
+    static void pwd(const Session& session);
+
+    // Method to append every file below the folder at path to out, in lproot order (files first, then subfolders)
+    void collectFiles(const Path& path, const Session& session, std::vector<const FileManager*>& out) const;
 
-    // Method to display the structure of the entire file system from the root
-    void lproot() const;
+    // Method to list every folder and file below this one as '/'-separated paths relative to it, in the form
+    // addTree takes (each folder after its parent); files receives the stored file of each entry of filePaths
+    void listTree(std::vector<std::string>& dirs, std::vector<std::string>& filePaths,
+                  std::vector<const FileManager*>& files) const;
 
-    // Static method to display the current working directory (PWD)
-    static void pwd();
+    // Method to mirror a tree below an existing folder in one pass. dirs and files hold '/'-separated paths
+    // relative to dest, each folder listed after its parent; missing folders are created and existing ones reused.
+    // added receives the stored file for each entry of files (an existing file is reused, nullptr if skipped).
+    // Returns false if dest does not exist
+    bool addTree(const Path& dest, const std::vector<std::string>& dirs,
+                 const std::vector<std::string>& files, std::vector<FileManager*>& added, Session& session);
 
-    // Method to add a file to the current folder
-    void addFile(const FileManager& fm);
+    // Method to add a file to the current folder (pass an rvalue to move it in)
+    void addFile(const Path& path, FileManager fm, Session& session);
 
     // Method to remove a file by its name
-    void removeFile(const std::string& filename);
+    void removeFile(const Path& path, Session& session);
 
-    // Method to retrieve a file by its name
-    FileManager* getFile(const std::string& name);
+    // Method to retrieve a file by its full internal path (O(1) lookup in the root's index)
+    FileManager* getFile(const Path& path);
 
     // Method to check if a folder exists at the specified path
-    bool folderExists(const std::string& fullPath) const;
+    bool folderExists(const Path& path, const Session& session) const;
 
     // Destructor to clean up the folder and its contents
     ~Folder();
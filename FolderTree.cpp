@@ -0,0 +1,54 @@
+#include "FolderTree.h"
+#include "Storage.h"
+#include "FileException.h"
+#include "Snapshot.h"
+#include "Reaper.h"
+
+const std::size_t FolderTree::FILE_LOCKS;
+
+// Select the backend, then create the root; a refused backend leaves nothing behind
+static Folder* newRoot(Storage::Mode mode) {
+    Storage::select(mode);
+    return new Folder("V");
+}
+
+// Constructor: the root is the first member, so nothing is built before the backend is settled
+FolderTree::FolderTree(Storage::Mode mode) : root(newRoot(mode)), sessionCount(0) {
+    root->setStructureLock(structureLock);
+}
+
+// Destructor: the last session is gone, so nothing else touches the tree
+FolderTree::~FolderTree() {
+    Storage::get().flushAll();
+    Reaper& reaper = Reaper::instance();
+    reaper.submitAll(*root, structureLock);
+    delete root;
+    reaper.drain();  // exit waits until the backing files are gone, so a restart finds none of them
+    Storage::get().closeAll();
+    Storage::release();
+    if (!journal) return;
+    try {
+        journal->reset();  // the files are gone, a restart has nothing to recover
+    } catch (const FileException&) {
+        // a later start replays the log over files that no longer exist, which is still correct
+    }
+}
+
+// Attach the mapped snapshot to the root; nothing below it is read yet
+void FolderTree::loadSnapshot(const std::string& path) {
+    std::unique_lock<std::shared_mutex> g(structureLock);
+    root->attach(Snapshot::open(path), 0);
+}
+
+// Mark where this run starts, so replayed sessions of an earlier run do not continue into it
+void FolderTree::setJournal(std::unique_ptr<Journal> j) {
+    journal = std::move(j);
+    journal->append(Journal::RESTART, std::string_view());
+    journal->sync();
+}
+
+// The stripe follows the backing file, so every link to it takes the same lock. The key is only changed
+// by structural operations (under the exclusive lock), never by a write detaching a shared value
+std::shared_mutex& FolderTree::fileLock(const FileManager* file) {
+    return fileLocks[file->getBackingKey() % FILE_LOCKS];
+}
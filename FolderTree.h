@@ -0,0 +1,64 @@
+#ifndef EX1_FOLDER_TREE_H
+#define EX1_FOLDER_TREE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include "Folder.h"
+#include "Journal.h"
+#include "Storage.h"
+
+// FolderTree class: the folder hierarchy shared by every Terminal session, with the locks that guard it.
+// Lookups and reads hold the structure lock shared; adding, moving or removing folders and files holds it
+// exclusively. A file's contents are guarded by its own lock (striped by backing file, which links share),
+// so sessions writing different files do not wait for each other. Take the structure lock before a file lock, never after.
+class FolderTree {
+public:
+    // Number of file lock stripes
+    static const std::size_t FILE_LOCKS = 64;
+
+    // Constructor: selects the Storage backend (throws if a live tree uses another one) and creates the root
+    // folder "V" in it
+    explicit FolderTree(Storage::Mode mode = Storage::Stream);
+
+    // Destructor: writes back pending data, removes the tree through the reaper, waits for it to finish
+    // and releases the backend's resources
+    ~FolderTree();
+
+    FolderTree(const FolderTree&) = delete;
+    FolderTree& operator=(const FolderTree&) = delete;
+
+    // The root folder
+    Folder& getRoot() { return *root; }
+
+    // Lock guarding the hierarchy and the root's indexes
+    std::shared_mutex& structure() { return structureLock; }
+
+    // Lock guarding the contents and size of one file
+    std::shared_mutex& fileLock(const FileManager* file);
+
+    // Start from the tree saved at path; folders are read from it when first used. The tree must be empty
+    void loadSnapshot(const std::string& path);
+
+    // Number identifying a new session in the journal
+    std::uint32_t newSession() { return sessionCount++; }
+
+    // Log every later change to the tree in journal; set before sessions other than the first start
+    void setJournal(std::unique_ptr<Journal> journal);
+
+    // The journal changes are logged to, or null
+    Journal* getJournal() const { return journal.get(); }
+
+private:
+    Folder* root;
+    std::unique_ptr<Journal> journal;
+    std::atomic<std::uint32_t> sessionCount;
+    std::shared_mutex structureLock;
+    std::array<std::shared_mutex, FILE_LOCKS> fileLocks;
+};
+
+#endif //EX1_FOLDER_TREE_H
@@ -0,0 +1,97 @@
+#ifndef EX1_FOLDER_WALK_H
+#define EX1_FOLDER_WALK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Folder.h"
+
+// Template class walking the folders below a starting folder without recursion. F is Folder or const Folder.
+// Depth first visits a folder before its subfolders, siblings in creation order (the order lproot prints);
+// breadth first visits a whole level before the next one. The folders still to visit are kept in a vector
+// that survives between walks, so the only allocations are the ones growing it to fit the tree.
+// Folders read from a snapshot are loaded as they are reached, unless the walk is told not to.
+template<class F>
+class FolderWalk {
+public:
+    enum Order { DepthFirst, BreadthFirst };
+
+    // Go at most maxDepth levels below the starting folder (0: the starting folder only)
+    explicit FolderWalk(Order order = DepthFirst, std::size_t maxDepth = SIZE_MAX, bool loadSnapshots = true)
+            : order(order), maxDepth(maxDepth), loadSnapshots(loadSnapshots),
+              current(nullptr), currentDepth(0), head(0), pruned(false) {}
+
+    // Begin a walk at from, which next() returns first, at depth 0
+    void start(F& from) {
+        pending.clear();
+        head = 0;
+        pending.push_back(Entry{&from, 0});
+        current = nullptr;
+        pruned = false;
+    }
+
+    // The next folder, or nullptr once the walk is over. The children of the folder returned before are
+    // queued only now, so prune() can still drop them
+    F* next() {
+        if (current) expand();
+        if (head == pending.size()) {
+            pending.clear();
+            head = 0;
+            return current = nullptr;
+        }
+        Entry e;
+        if (order == DepthFirst) {
+            e = pending.back();
+            pending.pop_back();
+        } else {
+            e = pending[head++];
+        }
+        current = e.folder;
+        currentDepth = e.depth;
+        if (loadSnapshots) current->load();
+        return current;
+    }
+
+    // Depth of the folder next() returned last (the starting folder is at 0)
+    std::size_t depth() const { return currentDepth; }
+
+    // Skip everything below the folder next() returned last
+    void prune() { pruned = true; }
+
+private:
+    struct Entry {
+        F* folder;
+        std::size_t depth;
+    };
+
+    // Queue the children of the current folder, unless they were pruned or lie too deep
+    void expand() {
+        bool skip = pruned || currentDepth >= maxDepth;
+        pruned = false;
+        if (skip) return;
+        if (order == DepthFirst) {
+            // pushed last to first, so the first child is popped next
+            for (auto it = current->subfolders.rbegin(); it != current->subfolders.rend(); ++it) {
+                pending.push_back(Entry{&*it, currentDepth + 1});
+            }
+            return;
+        }
+        if (head > 1024 && head * 2 > pending.size()) {
+            // drop the visited front of the queue so it does not grow with the whole tree
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(head));
+            head = 0;
+        }
+        for (auto& sf : current->subfolders) pending.push_back(Entry{&sf, currentDepth + 1});
+    }
+
+    Order order;
+    std::size_t maxDepth;
+    bool loadSnapshots;
+    std::vector<Entry> pending;  // Stack (depth first) or queue from head (breadth first)
+    F* current;                  // Folder next() returned last
+    std::size_t currentDepth;
+    std::size_t head;            // First unvisited entry of the queue; 0 while depth first
+    bool pruned;
+};
+
+#endif //EX1_FOLDER_WALK_H
@@ -0,0 +1,139 @@
+#include "HandlePool.h"
+#include "FileException.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// Default number of descriptors kept open before the least recently used one is closed
+static const std::size_t DEFAULT_CAPACITY = 128;
+
+// Handle constructor: pins the entry
+HandlePool::Handle::Handle(Entry* e) : entry(e) {
+    ++entry->pins;
+}
+
+// Move constructor: transfers the pin
+HandlePool::Handle::Handle(Handle&& rhs) noexcept : entry(rhs.entry) {
+    rhs.entry = nullptr;
+}
+
+// Destructor: releases the pin, the descriptor itself stays open in the pool
+HandlePool::Handle::~Handle() {
+    if (entry) --entry->pins;
+}
+
+// Mark the descriptor dirty and apply the flush policy
+void HandlePool::Handle::written() {
+    if (HandlePool::instance().policy == FlushEveryWrite) {
+        ::fdatasync(entry->fd);
+        entry->dirty = false;
+    } else {
+        entry->dirty = true;
+    }
+}
+
+HandlePool::HandlePool() : capacity(DEFAULT_CAPACITY), policy(FlushOnSync) {}
+
+// Destructor: flushes and closes whatever is still open at process exit
+HandlePool::~HandlePool() {
+    for (auto& e : entries) {
+        if (e.second.dirty) ::fdatasync(e.second.fd);
+        ::close(e.second.fd);
+    }
+}
+
+// Returns the process-wide pool
+HandlePool& HandlePool::instance() {
+    static HandlePool pool;
+    return pool;
+}
+
+// Open (or reuse) a descriptor for the path
+HandlePool::Handle HandlePool::open(const std::string& path, bool create) {
+    auto it = entries.find(path);
+    if (it != entries.end()) {
+        recency.splice(recency.begin(), recency, it->second.lru);
+        return Handle(&it->second);
+    }
+    if (entries.size() >= capacity) evict();
+
+    int flags = O_RDWR | O_CLOEXEC;
+    if (create) flags |= O_CREAT;
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + path);
+    }
+    recency.push_front(path);
+    Entry& e = entries[path];
+    e.fd = fd;
+    e.pins = 0;
+    e.dirty = false;
+    e.lru = recency.begin();
+    return Handle(&e);
+}
+
+// Returns true if the path currently has an open descriptor
+bool HandlePool::isOpen(const std::string& path) const {
+    return entries.find(path) != entries.end();
+}
+
+// fdatasync a single path if it has unsynced writes
+void HandlePool::sync(const std::string& path) {
+    auto it = entries.find(path);
+    if (it == entries.end() || !it->second.dirty) return;
+    ::fdatasync(it->second.fd);
+    it->second.dirty = false;
+}
+
+// fdatasync every descriptor with unsynced writes
+void HandlePool::syncAll() {
+    for (auto& e : entries) {
+        if (!e.second.dirty) continue;
+        ::fdatasync(e.second.fd);
+        e.second.dirty = false;
+    }
+}
+
+// Sync and close the descriptor of a path; the caller must not hold a Handle to it
+void HandlePool::close(const std::string& path) {
+    auto it = entries.find(path);
+    if (it == entries.end()) return;
+    if (it->second.dirty) ::fdatasync(it->second.fd);
+    ::close(it->second.fd);
+    recency.erase(it->second.lru);
+    entries.erase(it);
+}
+
+// Sync and close every unpinned descriptor
+void HandlePool::closeAll() {
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.pins > 0) { ++it; continue; }
+        if (it->second.dirty) ::fdatasync(it->second.fd);
+        ::close(it->second.fd);
+        recency.erase(it->second.lru);
+        it = entries.erase(it);
+    }
+}
+
+// Change the cap; shrinking closes descriptors immediately
+void HandlePool::setCapacity(std::size_t cap) {
+    capacity = cap < 2 ? 2 : cap;
+    while (entries.size() > capacity) {
+        std::size_t before = entries.size();
+        evict();
+        if (entries.size() == before) break;  // everything left is pinned
+    }
+}
+
+// Close the least recently used descriptor that is not pinned
+void HandlePool::evict() {
+    for (auto it = recency.rbegin(); it != recency.rend(); ++it) {
+        auto e = entries.find(*it);
+        if (e->second.pins > 0) continue;
+        if (e->second.dirty) ::fdatasync(e->second.fd);
+        ::close(e->second.fd);
+        recency.erase(std::next(it).base());
+        entries.erase(e);
+        return;
+    }
+}
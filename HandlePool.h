@@ -0,0 +1,94 @@
+#ifndef EX1_HANDLE_POOL_H
+#define EX1_HANDLE_POOL_H
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// HandlePool class: process-wide set of open file descriptors, capped with LRU eviction
+class HandlePool {
+public:
+    // When data written through a pooled descriptor is pushed to the device
+    enum FlushPolicy {
+        FlushOnSync,    // Writes stay in the kernel page cache until sync() or close
+        FlushEveryWrite // Every write is followed by fdatasync
+    };
+
+private:
+    struct Entry {
+        int fd;                                // Open descriptor for the path
+        int pins;                              // Number of live Handles using the descriptor
+        bool dirty;                            // Written since the last sync
+        std::list<std::string>::iterator lru;  // Position in the recency list
+    };
+
+public:
+    // Handle class: pins a pooled descriptor so it cannot be evicted while in use
+    class Handle {
+        friend class HandlePool;
+    private:
+        Entry* entry;
+        explicit Handle(Entry* e);
+    public:
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        Handle(Handle&& rhs) noexcept;
+        ~Handle();
+
+        // The underlying descriptor, valid for the lifetime of the Handle
+        int fd() const { return entry->fd; }
+
+        // Record a write so the flush policy can be applied
+        void written();
+    };
+
+    // Returns the process-wide pool
+    static HandlePool& instance();
+
+    // Open (or reuse) a descriptor for the path; creates the file when create is set
+    Handle open(const std::string& path, bool create = false);
+
+    // Returns true if the path currently has an open descriptor
+    bool isOpen(const std::string& path) const;
+
+    // fdatasync a single path if it has unsynced writes
+    void sync(const std::string& path);
+
+    // fdatasync every descriptor with unsynced writes
+    void syncAll();
+
+    // Sync and close the descriptor of a path (e.g. before the file is deleted)
+    void close(const std::string& path);
+
+    // Sync and close every unpinned descriptor
+    void closeAll();
+
+    // Maximum number of descriptors kept open at once (at least 2)
+    void setCapacity(std::size_t cap);
+    std::size_t getCapacity() const { return capacity; }
+
+    // When writes reach the device; set before any session starts writing
+    void setFlushPolicy(FlushPolicy p) { policy = p; }
+    FlushPolicy getFlushPolicy() const { return policy; }
+
+    // Number of descriptors currently open
+    std::size_t size() const { return entries.size(); }
+
+    HandlePool(const HandlePool&) = delete;
+    HandlePool& operator=(const HandlePool&) = delete;
+
+private:
+    HandlePool();
+    ~HandlePool();
+
+    // Close least recently used, unpinned descriptors until there is room for one more
+    void evict();
+
+    std::unordered_map<std::string, Entry> entries;  // Open descriptors by path
+    std::list<std::string> recency;                  // Most recently used path at the front
+    std::size_t capacity;
+    FlushPolicy policy;
+};
+
+#endif //EX1_HANDLE_POOL_H
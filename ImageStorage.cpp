@@ -0,0 +1,518 @@
+#include "ImageStorage.h"
+#include "FileException.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const std::size_t ImageStorage::BLOCK_SIZE;
+
+// Blocks in a new image (1 MiB); the image doubles whenever no free run is large enough
+static const std::uint64_t INITIAL_BLOCKS = 256;
+
+// Address space reserved for the mapping, so growing the image never moves it; halved until mmap accepts it
+static const std::size_t MAX_RESERVE = std::size_t(1) << 38;
+static const std::size_t MIN_RESERVE = std::size_t(1) << 30;
+
+// Blocks a growing file takes beyond what it needs at most, so appends stay in few extents
+static const std::size_t MAX_AHEAD = 256;
+
+// Bytes passed to sendfile() per call
+static const std::size_t SEND_CHUNK = 1 << 30;
+
+// Image file opened by the next open()
+static std::string imagePath = "V.img";
+
+// Block 0 of the image
+struct ImageHeader {
+    char magic[8];            // "VTIMAGE1"
+    std::uint64_t blockSize;  // BLOCK_SIZE of the process that wrote it
+    std::uint64_t dirStart;   // First block of the directory
+    std::uint64_t dirBlocks;  // Blocks holding the directory
+    std::uint64_t dirBytes;   // Bytes of directory data in them
+};
+
+static const char MAGIC[8] = {'V', 'T', 'I', 'M', 'A', 'G', 'E', '1'};
+
+// Number of blocks covering len bytes
+static std::uint64_t blocksFor(std::uint64_t len) {
+    return (len + ImageStorage::BLOCK_SIZE - 1) / ImageStorage::BLOCK_SIZE;
+}
+
+// Append a fixed-size value to the directory data
+template<class T>
+static void writeValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+// Read a fixed-size value from the directory data, failing on a cut-off directory
+template<class T>
+static T readValue(const char*& p, const char* end) {
+    if (static_cast<std::size_t>(end - p) < sizeof(T)) {
+        throw FileException(FileException::ErrorType::ReadError, "Image directory is damaged: " + imagePath);
+    }
+    T value;
+    std::memcpy(&value, p, sizeof value);
+    p += sizeof value;
+    return value;
+}
+
+ImageStorage::ImageStorage()
+        : fd(-1), base(nullptr), reserved(0), blockCount(0), dirStart(0), dirBlocks(0) {}
+
+// Destructor: writes the directory, and removes the image if no file is left in it
+ImageStorage::~ImageStorage() {
+    try {
+        closeAll();
+    } catch (const FileException&) {
+        // the image is gone, nothing left to record
+    }
+}
+
+// Image file used from the next time the image is opened
+void ImageStorage::setPath(const std::string& path) {
+    imagePath = path;
+}
+
+// Add an empty file to the directory if it is not there yet
+void ImageStorage::create(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    files[path];
+}
+
+// Drop the file from the directory and release the blocks nobody else shares
+bool ImageStorage::remove(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    auto it = files.find(path);
+    if (it == files.end()) return false;
+    unref(it->second.blocks);
+    files.erase(it);
+    return true;
+}
+
+// Copy straight out of the mapping, block by block
+std::size_t ImageStorage::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    const File& f = find(path);
+    if (offset >= f.length) return 0;
+    len = std::min(len, f.length - offset);
+    for (std::size_t done = 0; done < len;) {
+        std::size_t pos = offset + done;
+        std::size_t n = std::min(len - done, BLOCK_SIZE - pos % BLOCK_SIZE);
+        std::memcpy(buf + done, at(f.blocks[pos / BLOCK_SIZE]) + pos % BLOCK_SIZE, n);
+        done += n;
+    }
+    return len;
+}
+
+// Make room, split shared blocks off, then copy into the mapping; a gap before offset is zero-filled
+void ImageStorage::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    File& f = find(path);
+    if (len == 0) return;
+    std::size_t end = offset + len;
+    reserve(f, blocksFor(end));
+    std::size_t from = std::min(offset, f.length);  // the zero-filled gap is written too
+    unshare(f, from / BLOCK_SIZE, (end - 1) / BLOCK_SIZE);
+    for (std::size_t pos = from; pos < offset;) {
+        std::size_t n = std::min(offset - pos, BLOCK_SIZE - pos % BLOCK_SIZE);
+        std::memset(at(f.blocks[pos / BLOCK_SIZE]) + pos % BLOCK_SIZE, 0, n);
+        pos += n;
+    }
+    for (std::size_t done = 0; done < len;) {
+        std::size_t pos = offset + done;
+        std::size_t n = std::min(len - done, BLOCK_SIZE - pos % BLOCK_SIZE);
+        std::memcpy(at(f.blocks[pos / BLOCK_SIZE]) + pos % BLOCK_SIZE, buf + done, n);
+        done += n;
+    }
+    f.length = std::max(f.length, end);
+}
+
+// The target shares the source's blocks; no data moves until one of them is written
+void ImageStorage::copy(const std::string& source, const std::string& target) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    if (source == target) return;
+    const File& src = find(source);
+    File copied;
+    copied.length = src.length;
+    copied.blocks.assign(src.blocks.begin(), src.blocks.begin() + static_cast<std::ptrdiff_t>(blocksFor(src.length)));
+    for (std::uint64_t b : copied.blocks) ++refs[b];
+    File& dst = files[target];
+    unref(dst.blocks);
+    dst = std::move(copied);
+}
+
+// Sharing blocks inside the image is always possible
+bool ImageStorage::clone(const std::string& source, const std::string& target) {
+    copy(source, target);
+    return true;
+}
+
+// Move the directory entry, replacing any file there
+void ImageStorage::rename(const std::string& from, const std::string& to) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    auto it = files.find(from);
+    if (it == files.end()) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to rename file: " + from);
+    }
+    if (from == to) return;
+    File moved = std::move(it->second);
+    files.erase(it);
+    File& dst = files[to];
+    unref(dst.blocks);
+    dst = std::move(moved);
+}
+
+std::size_t ImageStorage::length(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    open();
+    return find(path).length;
+}
+
+// Pass each physically contiguous run of the file straight out of the mapping, without holding the lock.
+// The caller keeps the file from being written or removed meanwhile, and the mapping never moves
+void ImageStorage::scan(const std::string& path, const ChunkFn& fn) {
+    const File* f;
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        open();
+        f = &find(path);
+    }
+    std::size_t count = blocksFor(f->length);
+    for (std::size_t i = 0; i < count;) {
+        std::size_t j = i + 1;
+        while (j < count && f->blocks[j] == f->blocks[j - 1] + 1) ++j;
+        fn(at(f->blocks[i]), std::min(j * BLOCK_SIZE, f->length) - i * BLOCK_SIZE);
+        i = j;
+    }
+}
+
+// sendfile() each contiguous run from the image descriptor
+bool ImageStorage::sendTo(const std::string& path, int outFd, std::size_t& sent) {
+    sent = 0;
+    const File* f;
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        open();
+        f = &find(path);
+    }
+    std::size_t count = blocksFor(f->length);
+    for (std::size_t i = 0; i < count;) {
+        std::size_t j = i + 1;
+        while (j < count && f->blocks[j] == f->blocks[j - 1] + 1) ++j;
+        off_t off = static_cast<off_t>(f->blocks[i] * BLOCK_SIZE);
+        std::size_t left = std::min(j * BLOCK_SIZE, f->length) - i * BLOCK_SIZE;
+        while (left > 0) {
+            ssize_t n = ::sendfile(outFd, fd, &off, std::min(left, SEND_CHUNK));
+            if (n > 0) {
+                left -= static_cast<std::size_t>(n);
+                sent += static_cast<std::size_t>(n);
+                continue;
+            }
+            if (n < 0 && retrySend(outFd)) continue;
+            if (sent == 0 && n < 0 && (errno == EINVAL || errno == ENOSYS)) return false;  // let the caller copy
+            throw FileException(FileException::ErrorType::ReadError,
+                                "Failed to send file: " + path);
+        }
+        i = j;
+    }
+    return true;
+}
+
+// Record the current directory in the image
+void ImageStorage::flushAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    if (fd >= 0) writeDirectory(false);
+}
+
+// Record the directory and make the image durable
+void ImageStorage::syncAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    if (fd >= 0) writeDirectory(true);
+}
+
+// Record the directory and unmap the image; an image without files is deleted
+void ImageStorage::closeAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    if (fd < 0) return;
+    bool empty = files.empty();
+    if (!empty) writeDirectory(false);
+    ::munmap(base, reserved);
+    ::close(fd);
+    fd = -1;
+    base = nullptr;
+    files.clear();
+    refs.clear();
+    freeRuns.clear();
+    if (empty) std::remove(imagePath.c_str());
+}
+
+// Map the image, creating it or loading its directory, unless it is open already
+void ImageStorage::open() {
+    if (fd >= 0) return;
+    int f = ::open(imagePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (f < 0) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + imagePath);
+    }
+    struct stat st{};
+    void* m = MAP_FAILED;
+    if (::fstat(f, &st) == 0) {
+        reserved = MAX_RESERVE;
+        while ((m = ::mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, f, 0)) == MAP_FAILED &&
+               reserved > MIN_RESERVE) {
+            reserved /= 2;
+        }
+    }
+    if (m == MAP_FAILED) {
+        ::close(f);
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to map file: " + imagePath);
+    }
+    fd = f;
+    base = static_cast<char*>(m);
+    try {
+        if (st.st_size > 0) {
+            load();
+            return;
+        }
+        if (::ftruncate(fd, static_cast<off_t>(INITIAL_BLOCKS * BLOCK_SIZE)) != 0) {
+            throw FileException(FileException::ErrorType::WriteError,
+                                "Failed to grow image: " + imagePath);
+        }
+        blockCount = INITIAL_BLOCKS;
+        refs.assign(blockCount, 0);
+        refs[0] = 1;  // header
+        freeRuns.clear();
+        freeRuns[1] = blockCount - 1;
+        dirStart = dirBlocks = 0;
+        writeDirectory(false);
+    } catch (...) {
+        ::munmap(base, reserved);
+        ::close(fd);
+        fd = -1;
+        base = nullptr;
+        throw;
+    }
+}
+
+// Rebuild the in-memory state from the header and the directory of an existing image
+void ImageStorage::load() {
+    struct stat st{};
+    ::fstat(fd, &st);
+    ImageHeader h{};
+    if (static_cast<std::size_t>(st.st_size) >= BLOCK_SIZE) std::memcpy(&h, base, sizeof h);
+    if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0 || h.blockSize != BLOCK_SIZE) {
+        throw FileException(FileException::ErrorType::ReadError, "Not an image: " + imagePath);
+    }
+    blockCount = static_cast<std::uint64_t>(st.st_size) / BLOCK_SIZE;
+    if (blockCount * BLOCK_SIZE > reserved || h.dirStart + h.dirBlocks > blockCount ||
+        h.dirBytes > h.dirBlocks * BLOCK_SIZE) {
+        throw FileException(FileException::ErrorType::ReadError, "Image directory is damaged: " + imagePath);
+    }
+    refs.assign(blockCount, 0);
+    refs[0] = 1;
+    dirStart = h.dirStart;
+    dirBlocks = h.dirBlocks;
+    for (std::uint64_t b = 0; b < dirBlocks; ++b) refs[dirStart + b] = 1;
+
+    files.clear();
+    const char* p = at(dirStart);
+    const char* end = p + h.dirBytes;
+    std::uint64_t count = readValue<std::uint64_t>(p, end);
+    for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint32_t nameLen = readValue<std::uint32_t>(p, end);
+        if (static_cast<std::size_t>(end - p) < nameLen) {
+            throw FileException(FileException::ErrorType::ReadError, "Image directory is damaged: " + imagePath);
+        }
+        File& f = files[std::string(p, nameLen)];
+        p += nameLen;
+        f.length = readValue<std::uint64_t>(p, end);
+        std::uint32_t runs = readValue<std::uint32_t>(p, end);
+        for (std::uint32_t r = 0; r < runs; ++r) {
+            std::uint64_t start = readValue<std::uint64_t>(p, end);
+            std::uint64_t n = readValue<std::uint64_t>(p, end);
+            if (start + n > blockCount || start == 0) {
+                throw FileException(FileException::ErrorType::ReadError, "Image directory is damaged: " + imagePath);
+            }
+            for (std::uint64_t b = start; b < start + n; ++b) {
+                f.blocks.push_back(b);
+                ++refs[b];
+            }
+        }
+    }
+    freeRuns.clear();
+    for (std::uint64_t b = 1; b < blockCount;) {
+        if (refs[b]) { ++b; continue; }
+        std::uint64_t start = b;
+        while (b < blockCount && !refs[b]) ++b;
+        freeRuns[start] = b - start;
+    }
+}
+
+// Layout: file count, then per file its name, length and extents (first block, block count)
+void ImageStorage::writeDirectory(bool durable) {
+    std::string dir;
+    writeValue<std::uint64_t>(dir, files.size());
+    for (const auto& entry : files) {
+        const File& f = entry.second;
+        writeValue<std::uint32_t>(dir, static_cast<std::uint32_t>(entry.first.size()));
+        dir.append(entry.first);
+        writeValue<std::uint64_t>(dir, f.length);
+        std::size_t countAt = dir.size();
+        writeValue<std::uint32_t>(dir, 0);
+        std::uint32_t runs = 0;
+        std::size_t count = blocksFor(f.length);
+        for (std::size_t i = 0; i < count; ++runs) {
+            std::size_t j = i + 1;
+            while (j < count && f.blocks[j] == f.blocks[j - 1] + 1) ++j;
+            writeValue<std::uint64_t>(dir, f.blocks[i]);
+            writeValue<std::uint64_t>(dir, j - i);
+            i = j;
+        }
+        std::memcpy(&dir[countAt], &runs, sizeof runs);
+    }
+
+    std::uint64_t blocks = blocksFor(dir.size());
+    std::uint64_t start = allocate(blocks);
+    std::memcpy(at(start), dir.data(), dir.size());
+    if (durable) ::msync(base, blockCount * BLOCK_SIZE, MS_SYNC);
+
+    ImageHeader h;
+    std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+    h.blockSize = BLOCK_SIZE;
+    h.dirStart = start;
+    h.dirBlocks = blocks;
+    h.dirBytes = dir.size();
+    std::memcpy(base, &h, sizeof h);
+    if (durable) ::msync(base, BLOCK_SIZE, MS_SYNC);
+
+    for (std::uint64_t b = dirStart; b < dirStart + dirBlocks; ++b) refs[b] = 0;
+    if (dirBlocks) release(dirStart, dirBlocks);
+    dirStart = start;
+    dirBlocks = blocks;
+}
+
+// The file at path; a missing one fails like opening a missing backing file
+ImageStorage::File& ImageStorage::find(const std::string& path) {
+    auto it = files.find(path);
+    if (it == files.end()) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + path);
+    }
+    return it->second;
+}
+
+// First fit over the free runs; when none is large enough the image at least doubles
+std::uint64_t ImageStorage::allocate(std::uint64_t count) {
+    auto it = freeRuns.begin();
+    while (it != freeRuns.end() && it->second < count) ++it;
+    if (it == freeRuns.end()) {
+        std::uint64_t added = std::max(count, blockCount);
+        if ((blockCount + added) * BLOCK_SIZE > reserved ||
+            ::ftruncate(fd, static_cast<off_t>((blockCount + added) * BLOCK_SIZE)) != 0) {
+            throw FileException(FileException::ErrorType::WriteError,
+                                "Failed to grow image: " + imagePath);
+        }
+        refs.resize(blockCount + added, 0);
+        release(blockCount, added);
+        blockCount += added;
+        it = std::prev(freeRuns.end());  // the new tail run, merged with any free run before it
+    }
+    std::uint64_t start = it->first;
+    std::uint64_t left = it->second - count;
+    freeRuns.erase(it);
+    if (left) freeRuns[start + count] = left;
+    for (std::uint64_t b = start; b < start + count; ++b) refs[b] = 1;
+    return start;
+}
+
+// Take [start, start + count) out of the free run holding it
+bool ImageStorage::claim(std::uint64_t start, std::uint64_t count) {
+    auto it = freeRuns.upper_bound(start);
+    if (it == freeRuns.begin()) return false;
+    --it;
+    std::uint64_t runStart = it->first, runEnd = it->first + it->second;
+    if (start + count > runEnd) return false;
+    freeRuns.erase(it);
+    if (start > runStart) freeRuns[runStart] = start - runStart;
+    if (runEnd > start + count) freeRuns[start + count] = runEnd - (start + count);
+    for (std::uint64_t b = start; b < start + count; ++b) refs[b] = 1;
+    return true;
+}
+
+// Insert a free run, merging it with the runs right before and after it
+void ImageStorage::release(std::uint64_t start, std::uint64_t count) {
+    auto next = freeRuns.lower_bound(start);
+    if (next != freeRuns.end() && start + count == next->first) {
+        count += next->second;
+        next = freeRuns.erase(next);
+    }
+    if (next != freeRuns.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == start) {
+            prev->second += count;
+            return;
+        }
+    }
+    freeRuns.emplace_hint(next, start, count);
+}
+
+// Drop one reference per block, freeing consecutive blocks as one run
+void ImageStorage::unref(const std::vector<std::uint64_t>& blocks) {
+    for (std::size_t i = 0; i < blocks.size();) {
+        if (--refs[blocks[i]] != 0) { ++i; continue; }
+        std::size_t j = i + 1;
+        while (j < blocks.size() && blocks[j] == blocks[j - 1] + 1 && refs[blocks[j]] == 1) {
+            refs[blocks[j]] = 0;
+            ++j;
+        }
+        release(blocks[i], j - i);
+        i = j;
+    }
+}
+
+// Extend the file's last extent in place when the blocks after it are free, otherwise take a new extent
+void ImageStorage::reserve(File& f, std::size_t count) {
+    if (f.blocks.size() >= count) return;
+    std::size_t need = count - f.blocks.size();
+    std::size_t want = need + std::min(f.blocks.size(), MAX_AHEAD);
+    std::uint64_t start;
+    if (!f.blocks.empty() && claim(f.blocks.back() + 1, want)) {
+        start = f.blocks.back() + 1;
+    } else if (!f.blocks.empty() && want > need && claim(f.blocks.back() + 1, need)) {
+        start = f.blocks.back() + 1;
+        want = need;
+    } else {
+        start = allocate(want);
+    }
+    for (std::uint64_t b = start; b < start + want; ++b) f.blocks.push_back(b);
+}
+
+// Copy each run of shared blocks into a newly allocated run and point the file at it
+void ImageStorage::unshare(File& f, std::size_t first, std::size_t last) {
+    for (std::size_t i = first; i <= last && i < f.blocks.size();) {
+        if (refs[f.blocks[i]] <= 1) { ++i; continue; }
+        std::size_t j = i + 1;
+        while (j <= last && j < f.blocks.size() && refs[f.blocks[j]] > 1) ++j;
+        std::uint64_t start = allocate(j - i);
+        for (std::size_t k = i; k < j; ++k) {
+            std::memcpy(at(start + (k - i)), at(f.blocks[k]), BLOCK_SIZE);
+            --refs[f.blocks[k]];  // still referenced by the other owners
+            f.blocks[k] = start + (k - i);
+        }
+        i = j;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef EX1_IMAGE_STORAGE_H
+#define EX1_IMAGE_STORAGE_H
+
+#include "Storage.h"
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// ImageStorage class: packs every file into one image file, mapped into memory once.
+// The image is split into BLOCK_SIZE blocks. A per-block reference count is the free-space map
+// (0 means free), and free runs are handed out as extents, first fit, growing the image when none
+// is large enough. Each file is a list of blocks; a copy shares the source's blocks and a write to
+// a shared block moves that block to a new one first, so creating, deleting and copying only change
+// metadata. The directory of files and extents is written into the image on flush, and read back
+// when an existing image is opened. Each call holds the backend's lock, except while a file is
+// scanned or sent.
+class ImageStorage : public Storage {
+public:
+    // Unit of allocation and sharing
+    static const std::size_t BLOCK_SIZE = 4096;
+
+private:
+    struct File {
+        std::size_t length = 0;             // Logical file length
+        std::vector<std::uint64_t> blocks;  // Image block holding each block of the file
+    };
+
+public:
+    ImageStorage();
+    ~ImageStorage() override;
+
+    // Image file used from the next time the image is opened (default "V.img" in the working directory)
+    static void setPath(const std::string& path);
+
+    void create(const std::string& path) override;
+    bool remove(const std::string& path) override;
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) override;
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) override;
+    void copy(const std::string& source, const std::string& target) override;
+    bool clone(const std::string& source, const std::string& target) override;
+    void rename(const std::string& from, const std::string& to) override;
+    std::size_t length(const std::string& path) override;
+    void scan(const std::string& path, const ChunkFn& fn) override;
+    bool sendTo(const std::string& path, int outFd, std::size_t& sent) override;
+    void flushAll() override;
+    void syncAll() override;
+    void closeAll() override;
+
+private:
+    // Map the image, creating it or loading its directory, unless it is open already
+    void open();
+
+    // Read the directory of an existing image and rebuild the reference counts and free runs from it
+    void load();
+
+    // Write the directory into newly allocated blocks and point the header at it; durable syncs the
+    // blocks before the header is switched over, so a crash leaves either directory intact
+    void writeDirectory(bool durable);
+
+    // The file at path; throws like opening a missing backing file
+    File& find(const std::string& path);
+
+    // Take a free run of count blocks, growing the image if needed; returns its first block
+    std::uint64_t allocate(std::uint64_t count);
+
+    // Take the count free blocks starting at start out of the free runs, if they are all free
+    bool claim(std::uint64_t start, std::uint64_t count);
+
+    // Return a run of blocks to the free runs, merging with its neighbours
+    void release(std::uint64_t start, std::uint64_t count);
+
+    // Drop one reference to each block; blocks nobody uses any more become free
+    void unref(const std::vector<std::uint64_t>& blocks);
+
+    // Give the file at least count blocks, in place after its last block when that run is free
+    void reserve(File& f, std::size_t count);
+
+    // Give the file its own copy of the shared blocks in [first, last]
+    void unshare(File& f, std::size_t first, std::size_t last);
+
+    // Address of an image block in the mapping
+    char* at(std::uint64_t block) const { return base + block * BLOCK_SIZE; }
+
+    int fd;                                           // Descriptor of the image, -1 while closed
+    char* base;                                       // Mapping reserved for the largest image, fixed while open
+    std::size_t reserved;                             // Bytes of address space reserved for the mapping
+    std::uint64_t blockCount;                         // Blocks in the image file
+    std::vector<std::uint32_t> refs;                  // References to each block (0: free)
+    std::map<std::uint64_t, std::uint64_t> freeRuns;  // Free blocks as runs: first block -> block count
+    std::uint64_t dirStart, dirBlocks;                // Blocks holding the on-image directory
+    std::unordered_map<std::string, File> files;      // Directory: files by path
+};
+
+#endif //EX1_IMAGE_STORAGE_H
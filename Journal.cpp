@@ -0,0 +1,195 @@
+#include "Journal.h"
+#include "FileException.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Record header: payload length, session, checksum of the payload
+static const std::size_t HEADER = 3 * sizeof(std::uint32_t);
+
+// OnSync policy: buffered records are written once this many bytes have collected
+static const std::size_t BATCH_BYTES = 1 << 20;
+
+// CRC-32 (IEEE) of a byte range, used to find the torn tail of the log
+static std::uint32_t checksum(const char* data, std::size_t len) {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    std::uint32_t c = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < len; ++i) {
+        c = table[(c ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+Journal::Journal(const std::string& path, Policy policy, unsigned interval)
+        : path(path), fd(::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)),
+          policy(policy), interval(interval < 1 ? 1 : interval),
+          appended(0), written(0), synced(0), end(0), torn(false), writing(false), stopping(false) {
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0) end = static_cast<std::uint64_t>(st.st_size);
+    if (fd >= 0 && policy == Interval) flusher = std::thread(&Journal::run, this);
+}
+
+// Destructor: stops the background thread and syncs what is left
+Journal::~Journal() {
+    if (flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        flusher.join();
+    }
+    if (fd < 0) return;
+    try {
+        sync();
+    } catch (const FileException&) {
+        // the records are lost, there is nobody left to tell
+    }
+    ::close(fd);
+}
+
+// Pass every intact record to fn in order, then cut off a torn tail
+std::size_t Journal::replay(const RecordFn& fn) {
+    if (fd < 0) return 0;
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        throw FileException(FileException::ErrorType::ReadError, "Failed to read journal: " + path);
+    }
+    std::string log(static_cast<std::size_t>(st.st_size), '\0');
+    std::size_t got = 0;
+    while (got < log.size()) {
+        ssize_t n = ::pread(fd, &log[got], log.size() - got, static_cast<off_t>(got));
+        if (n < 0) {
+            throw FileException(FileException::ErrorType::ReadError, "Failed to read journal: " + path);
+        }
+        if (n == 0) break;
+        got += static_cast<std::size_t>(n);
+    }
+    log.resize(got);
+
+    std::size_t pos = 0, commands = 0;
+    while (log.size() - pos >= HEADER) {
+        std::uint32_t header[3];
+        std::memcpy(header, log.data() + pos, HEADER);
+        if (header[0] > log.size() - pos - HEADER) break;  // cut short by a crash
+        const char* payload = log.data() + pos + HEADER;
+        if (checksum(payload, header[0]) != header[2]) break;
+        pos += HEADER + header[0];
+        fn(header[1], std::string_view(payload, header[0]));
+        if (header[1] != RESTART) ++commands;
+    }
+    if (pos < log.size() && ::ftruncate(fd, static_cast<off_t>(pos)) < 0) {
+        throw FileException(FileException::ErrorType::WriteError, "Failed to truncate journal: " + path);
+    }
+    std::lock_guard<std::mutex> g(lock);
+    end = pos;
+    return commands;
+}
+
+// Log a command line of a session; returns its sequence number for commit()
+std::uint64_t Journal::append(std::uint32_t session, std::string_view line) {
+    std::uint32_t header[3] = {static_cast<std::uint32_t>(line.size()), session,
+                               checksum(line.data(), line.size())};
+    std::unique_lock<std::mutex> g(lock);
+    buffer.append(reinterpret_cast<const char*>(header), HEADER);
+    buffer.append(line.data(), line.size());
+    std::uint64_t seq = ++appended;
+    if (policy == OnSync && buffer.size() >= BATCH_BYTES && !writing) writeOut(g, false);
+    return seq;
+}
+
+// Block until record seq is as durable as the policy promises before a command is acknowledged
+void Journal::commit(std::uint64_t seq) {
+    if (policy != EveryOp) return;
+    std::unique_lock<std::mutex> g(lock);
+    while (synced < seq) {
+        // The first waiter writes everything buffered so far, later ones ride along on its fdatasync
+        if (writing) done.wait(g);
+        else writeOut(g, true);
+    }
+}
+
+// Write and sync every record appended so far
+void Journal::sync() {
+    std::unique_lock<std::mutex> g(lock);
+    std::uint64_t target = appended;
+    while (synced < target) {
+        if (writing) done.wait(g);
+        else writeOut(g, true);
+    }
+}
+
+// Drop every record: the tree they describe is gone
+void Journal::reset() {
+    std::unique_lock<std::mutex> g(lock);
+    while (writing) done.wait(g);
+    buffer.clear();
+    written = synced = appended;
+    end = 0;
+    torn = false;
+    if (fd >= 0 && (::ftruncate(fd, 0) < 0 || ::fdatasync(fd) < 0)) {
+        throw FileException(FileException::ErrorType::WriteError, "Failed to truncate journal: " + path);
+    }
+}
+
+// Write the buffered records, and fdatasync them if durable is set. A failed batch is kept for the next
+// attempt, which first cuts off whatever part of it reached the file: left in the middle of the log,
+// a torn record would make replay() drop every record after it
+void Journal::writeOut(std::unique_lock<std::mutex>& g, bool durable) {
+    writing = true;
+    std::string batch;
+    batch.swap(buffer);
+    std::uint64_t target = appended;
+    std::uint64_t start = end;
+    bool cut = torn;
+    g.unlock();
+
+    bool ok = !cut || ::ftruncate(fd, static_cast<off_t>(start)) == 0;
+    for (std::size_t off = 0; ok && off < batch.size();) {
+        ssize_t n = ::write(fd, batch.data() + off, batch.size() - off);
+        if (n <= 0) ok = false;
+        else off += static_cast<std::size_t>(n);
+    }
+    if (ok && durable && ::fdatasync(fd) < 0) ok = false;
+
+    g.lock();
+    writing = false;
+    if (ok) {
+        written = target;
+        if (durable) synced = target;
+        end = start + batch.size();
+        torn = false;
+    } else {
+        buffer.insert(0, batch);  // records appended meanwhile stay behind it, in log order
+        torn = true;
+    }
+    done.notify_all();
+    if (!ok) {
+        throw FileException(FileException::ErrorType::WriteError, "Failed to write journal: " + path);
+    }
+}
+
+// Interval policy: sync every interval milliseconds until stopped
+void Journal::run() {
+    std::unique_lock<std::mutex> g(lock);
+    while (!stopping) {
+        wake.wait_for(g, std::chrono::milliseconds(interval));
+        if (stopping || writing || synced == appended) continue;
+        try {
+            writeOut(g, true);
+        } catch (const FileException&) {
+            // the records stay unsynced; sync() reports the failure to a session
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef EX1_JOURNAL_H
+#define EX1_JOURNAL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Journal class: write-ahead log of the commands that change the tree, so a crashed run can be rebuilt.
+// Sessions append records while they hold the locks of the command, so the log order is the order the
+// changes were made in. Records are collected in memory and written in batches; how soon a command is
+// acknowledged depends on the fsync policy. When several sessions wait at once, one fdatasync covers
+// all of them (group commit). A batch that fails to be written stays buffered and is written again,
+// after the log is cut back to its last whole record.
+class Journal {
+public:
+    // When appended records are made durable
+    enum Policy {
+        EveryOp,   // Each command waits for its record to be synced (batched across sessions)
+        Interval,  // A background thread syncs every interval milliseconds; commands do not wait
+        OnSync     // Records reach the file in large writes and are synced only by sync()
+    };
+
+    // Session number of the record that marks the start of a run; replayed sessions end there
+    static const std::uint32_t RESTART = 0xFFFFFFFFu;
+
+    // Callback receiving the session and command line of each replayed record
+    typedef std::function<void(std::uint32_t, std::string_view)> RecordFn;
+
+    // Open (or create) the journal at path
+    Journal(const std::string& path, Policy policy, unsigned interval = 10);
+
+    // Destructor: stops the background thread and syncs what is left
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // The file could be opened
+    bool good() const { return fd >= 0; }
+
+    // Pass every intact record to fn in order, then cut off a torn tail; returns the number of commands
+    std::size_t replay(const RecordFn& fn);
+
+    // Log a command line of a session; returns its sequence number for commit()
+    std::uint64_t append(std::uint32_t session, std::string_view line);
+
+    // Block until record seq is as durable as the policy promises before a command is acknowledged
+    void commit(std::uint64_t seq);
+
+    // Write and sync every record appended so far
+    void sync();
+
+    // Drop every record: the tree they describe is gone
+    void reset();
+
+private:
+    // Write the buffered records, and fdatasync them if durable is set; g must be held and no batch in flight.
+    // The lock is released while the file is written. On failure the batch is put back in front of the buffer
+    void writeOut(std::unique_lock<std::mutex>& g, bool durable);
+
+    // Interval policy: sync every interval milliseconds until stopped
+    void run();
+
+    std::string path;
+    int fd;
+    Policy policy;
+    unsigned interval;
+
+    std::mutex lock;                 // Guards the fields below
+    std::condition_variable done;    // Signalled when a batch has been written
+    std::string buffer;              // Encoded records not written yet
+    std::uint64_t appended;          // Sequence number of the last appended record
+    std::uint64_t written;           // Records up to here are in the file
+    std::uint64_t synced;            // Records up to here are durable
+    std::uint64_t end;               // Length of the log up to the last batch written in full
+    bool torn;                       // A failed batch may have left part of itself after end
+    bool writing;                    // A batch is being written outside the lock
+    bool stopping;
+    std::condition_variable wake;    // Wakes the interval thread early when stopping
+    std::thread flusher;             // Runs run() under the Interval policy
+};
+
+#endif //EX1_JOURNAL_H
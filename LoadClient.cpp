@@ -0,0 +1,164 @@
+#include "LoadClient.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+// Length of each connection's own file
+static const int FILE_LENGTH = 256;
+
+// Bytes received per recv() call
+static const std::size_t READ_BLOCK = 64 * 1024;
+
+// Results of one connection
+struct LoadResult {
+    std::vector<double> latencies;  // Microseconds from sending a command to the end of its response
+    std::size_t errors = 0;         // Responses starting with ERROR
+    bool failed = false;            // The connection broke before every response arrived
+};
+
+// Connect to the server's socket; -1 on failure
+static int connectTo(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof addr.sun_path) return -1;
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// send() the whole buffer
+static bool sendAll(int fd, const std::string& data) {
+    std::size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// The i-th command of a connection's mix
+static void command(std::string& line, const std::string& file, std::size_t i) {
+    char buf[96];
+    int at = static_cast<int>(i * 37 % (FILE_LENGTH - 16));
+    switch (i % 5) {
+        case 0: std::snprintf(buf, sizeof buf, "readrange %s %d 32\n", file.c_str(), at); break;
+        case 1: std::snprintf(buf, sizeof buf, "read %s %d\n", file.c_str(), at); break;
+        case 2: std::snprintf(buf, sizeof buf, "wc %s\n", file.c_str()); break;
+        case 3: std::snprintf(buf, sizeof buf, "writestr %s %d load %zu\n", file.c_str(), at, i % 1000); break;
+        default: std::snprintf(buf, sizeof buf, "pwd\n"); break;
+    }
+    line += buf;
+}
+
+// One connection: set up its file, then keep depth commands in flight until requests responses arrived
+static void drive(const std::string& path, unsigned id, std::size_t requests, unsigned depth, LoadResult& result) {
+    int fd = connectTo(path);
+    if (fd < 0) {
+        result.failed = true;
+        return;
+    }
+    std::string file = "V/load" + std::to_string(id);
+    std::string setup = "touch " + file + "\nwritestr " + file + " 0 " + std::string(FILE_LENGTH, 'x') + "\n";
+    std::size_t sent = 0, received = 0, skip = 2;  // the two setup responses are not timed
+    std::deque<Clock::time_point> inFlight;
+    std::string batch;
+    char buf[READ_BLOCK];
+    bool atStart = true;  // the next byte begins a response
+    result.failed = !sendAll(fd, setup);
+    result.latencies.reserve(requests);
+    while (!result.failed && received < requests) {
+        if (skip == 0) {
+            batch.clear();
+            while (sent < requests && sent - received < depth) {
+                command(batch, file, sent++);
+                inFlight.push_back(Clock::now());
+            }
+            if (!batch.empty() && !sendAll(fd, batch)) {
+                result.failed = true;
+                break;
+            }
+        }
+        ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            result.failed = true;
+            break;
+        }
+        Clock::time_point now = Clock::now();
+        for (ssize_t i = 0; i < n; ++i) {
+            if (atStart && skip == 0 && buf[i] == 'E' && n - i >= 5 && std::memcmp(buf + i, "ERROR", 5) == 0) {
+                ++result.errors;
+            }
+            atStart = buf[i] == '\0';
+            if (!atStart) continue;
+            if (skip > 0) {
+                --skip;
+                continue;
+            }
+            result.latencies.push_back(std::chrono::duration<double, std::micro>(now - inFlight.front()).count());
+            inFlight.pop_front();
+            ++received;
+        }
+    }
+    ::close(fd);
+}
+
+// Latency at quantile q of sorted samples
+static double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    std::size_t i = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+// Run the connections in parallel and print the totals
+int LoadClient::run(const std::string& path, unsigned connections, std::size_t requests, unsigned depth) {
+    if (connections == 0) connections = 1;
+    if (depth == 0) depth = 1;
+    std::vector<LoadResult> results(connections);
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < connections; ++c) {
+        threads.emplace_back(drive, std::cref(path), c, requests, depth, std::ref(results[c]));
+    }
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    std::size_t errors = 0, failed = 0;
+    for (auto& r : results) {
+        all.insert(all.end(), r.latencies.begin(), r.latencies.end());
+        errors += r.errors;
+        if (r.failed) ++failed;
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << "Connections: " << connections << ", Depth: " << depth
+              << ", Requests: " << all.size() << std::fixed
+              << ", Seconds: " << std::setprecision(3) << seconds
+              << ", Requests/s: " << std::setprecision(0) << static_cast<double>(all.size()) / seconds
+              << std::setprecision(1)
+              << ", p50: " << percentile(all, 0.50) << " us"
+              << ", p99: " << percentile(all, 0.99) << " us"
+              << ", Max: " << (all.empty() ? 0.0 : all.back()) << " us"
+              << ", Errors: " << errors << std::endl;
+    if (failed > 0) std::cerr << "ERROR: " << failed << " connection(s) failed" << std::endl;
+    return failed == 0 && errors == 0 ? 0 : 1;
+}
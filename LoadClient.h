@@ -0,0 +1,18 @@
+#ifndef EX1_LOAD_CLIENT_H
+#define EX1_LOAD_CLIENT_H
+
+#include <cstddef>
+#include <string>
+
+// LoadClient class: load generator for the socket server (SocketServer).
+// Opens several connections, one thread each, keeps up to depth commands in flight on every connection
+// and reports requests per second with latency percentiles. Each connection works on a file of its own
+// (V/load<N>), mixing reads, word counts and writes.
+class LoadClient {
+public:
+    // Send requests commands on each of connections connections; returns 0 if every response arrived
+    static int run(const std::string& path, unsigned connections = 4, std::size_t requests = 100000,
+                   unsigned depth = 16);
+};
+
+#endif //EX1_LOAD_CLIENT_H
@@ -0,0 +1,128 @@
+#include "MemoryStorage.h"
+#include "FileException.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+const std::size_t MemoryStorage::PIECE_SIZE;
+
+// Create the file if it does not exist yet
+void MemoryStorage::create(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    FileRef& f = files[path];
+    if (!f) f = std::make_shared<File>();
+}
+
+// Drop the file's bytes; a scan still running keeps them alive until it ends
+bool MemoryStorage::remove(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    return files.erase(path) > 0;
+}
+
+// Copy up to len bytes at offset into buf, piece by piece
+std::size_t MemoryStorage::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    const File& f = *find(path);
+    if (offset >= f.length) return 0;
+    len = std::min(len, f.length - offset);
+    for (std::size_t done = 0; done < len;) {
+        std::size_t pos = offset + done;
+        const std::vector<char>& piece = f.pieces[pos / PIECE_SIZE];
+        std::size_t n = std::min(len - done, PIECE_SIZE - pos % PIECE_SIZE);
+        std::memcpy(buf + done, piece.data() + pos % PIECE_SIZE, n);
+        done += n;
+    }
+    return len;
+}
+
+// Write len bytes at offset; a gap before offset reads as zeros, like a hole in a backing file
+void MemoryStorage::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    File& f = *find(path);
+    std::size_t end = offset + len;
+    if (end > f.length) {
+        std::size_t count = (end + PIECE_SIZE - 1) / PIECE_SIZE;
+        if (f.pieces.size() < count) f.pieces.resize(count);
+        for (std::size_t i = f.length / PIECE_SIZE; i < count; ++i) {
+            f.pieces[i].resize(std::min(PIECE_SIZE, end - i * PIECE_SIZE));  // zero-fills the gap
+        }
+        f.length = end;
+    }
+    for (std::size_t done = 0; done < len;) {
+        std::size_t pos = offset + done;
+        std::vector<char>& piece = f.pieces[pos / PIECE_SIZE];
+        std::size_t n = std::min(len - done, PIECE_SIZE - pos % PIECE_SIZE);
+        std::memcpy(piece.data() + pos % PIECE_SIZE, buf + done, n);
+        done += n;
+    }
+}
+
+// Replace the target's contents with a copy of the source's
+void MemoryStorage::copy(const std::string& source, const std::string& target) {
+    std::lock_guard<std::mutex> g(stateLock);
+    if (source == target) return;
+    File contents = *find(source);
+    files[target] = std::make_shared<File>(std::move(contents));
+}
+
+// Move the contents to a new path, replacing any file there
+void MemoryStorage::rename(const std::string& from, const std::string& to) {
+    std::lock_guard<std::mutex> g(stateLock);
+    auto it = files.find(from);
+    if (it == files.end()) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to rename file: " + from);
+    }
+    FileRef f = std::move(it->second);
+    files.erase(it);
+    files[to] = std::move(f);
+}
+
+std::size_t MemoryStorage::length(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    return find(path)->length;
+}
+
+// Pass each piece to fn without holding the lock; the reference keeps the bytes alive if the file is removed
+void MemoryStorage::scan(const std::string& path, const ChunkFn& fn) {
+    FileRef f;
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        f = find(path);
+    }
+    for (std::size_t i = 0, left = f->length; left > 0; ++i) {
+        std::size_t n = std::min(left, PIECE_SIZE);
+        fn(f->pieces[i].data(), n);
+        left -= n;
+    }
+}
+
+// The bytes are already in memory, so they are written to outFd straight from the pieces
+bool MemoryStorage::sendTo(const std::string& path, int outFd, std::size_t& sent) {
+    sent = 0;
+    scan(path, [&](const char* data, std::size_t len) {
+        while (len > 0) {
+            ssize_t n = ::write(outFd, data, len);
+            if (n < 0 && retrySend(outFd)) continue;
+            if (n <= 0) {
+                throw FileException(FileException::ErrorType::WriteError,
+                                    "Failed to send file: " + path);
+            }
+            data += n;
+            len -= static_cast<std::size_t>(n);
+            sent += static_cast<std::size_t>(n);
+        }
+    });
+    return true;
+}
+
+// The file at path; a missing one fails like opening a missing backing file
+const MemoryStorage::FileRef& MemoryStorage::find(const std::string& path) {
+    auto it = files.find(path);
+    if (it == files.end()) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + path);
+    }
+    return it->second;
+}
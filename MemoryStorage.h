@@ -0,0 +1,46 @@
+#ifndef EX1_MEMORY_STORAGE_H
+#define EX1_MEMORY_STORAGE_H
+
+#include "Storage.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// MemoryStorage class: keeps every file in process memory and never touches the disk.
+// A small file is one contiguous buffer that grows in place; once it passes PIECE_SIZE it continues in
+// further fixed-size pieces (a flat rope), so growing a large file never moves the bytes already written.
+// Each call holds the backend's lock, except while a file is scanned or sent.
+class MemoryStorage : public Storage {
+public:
+    // Size of every piece but the last one
+    static const std::size_t PIECE_SIZE = 1 << 20;
+
+private:
+    struct File {
+        std::vector<std::vector<char>> pieces;  // Contents, PIECE_SIZE bytes per piece but the last
+        std::size_t length = 0;                 // Logical file length
+    };
+    typedef std::shared_ptr<File> FileRef;
+
+public:
+    void create(const std::string& path) override;
+    bool remove(const std::string& path) override;
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) override;
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) override;
+    void copy(const std::string& source, const std::string& target) override;
+    void rename(const std::string& from, const std::string& to) override;
+    std::size_t length(const std::string& path) override;
+    void scan(const std::string& path, const ChunkFn& fn) override;
+    bool sendTo(const std::string& path, int outFd, std::size_t& sent) override;
+    void flushAll() override {}
+    void syncAll() override {}
+    void closeAll() override {}
+
+private:
+    // The file at path; throws like opening a missing backing file
+    const FileRef& find(const std::string& path);
+
+    std::unordered_map<std::string, FileRef> files;  // Contents by path
+};
+
+#endif //EX1_MEMORY_STORAGE_H
@@ -0,0 +1,316 @@
+#include "MmapStorage.h"
+#include "HandlePool.h"
+#include "FileException.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Files are mapped and grown in multiples of this size
+static const std::size_t MAP_CHUNK = 64 * 1024;
+
+// Number of files mapped at once, 1024 unless setCapacity() chose another
+static std::size_t configuredCapacity = 1024;
+
+// Round n up to a whole number of chunks (at least one)
+static std::size_t roundChunk(std::size_t n) {
+    if (n == 0) return MAP_CHUNK;
+    return (n + MAP_CHUNK - 1) / MAP_CHUNK * MAP_CHUNK;
+}
+
+MmapStorage::MmapStorage() : capacity(configuredCapacity) {}
+
+// Destructor: unmaps and trims everything still mapped
+MmapStorage::~MmapStorage() {
+    try {
+        closeAll();
+    } catch (const FileException&) {
+        // the backing file is gone, nothing left to trim
+    }
+}
+
+// Create the backing file if it does not exist yet
+void MmapStorage::create(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    HandlePool::instance().open(path, true);
+}
+
+// Drop the mapping and the pooled descriptor, then delete the backing file
+bool MmapStorage::remove(const std::string& path) {
+    std::unique_lock<std::mutex> g(stateLock);
+    auto it = findUnpinned(g, path);
+    if (it != maps.end()) unmap(it, false);
+    HandlePool::instance().close(path);
+    if (std::remove(path.c_str()) != 0) {
+        if (errno == ENOENT) return false;  // the file never existed on disk
+        throw FileException(FileException::ErrorType::DeleteError,
+                            "Failed to delete file: " + path);
+    }
+    return true;
+}
+
+// Copy straight out of the mapping
+std::size_t MmapStorage::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    Mapping& m = map(path);
+    if (offset >= m.length) return 0;
+    std::size_t n = std::min(len, m.length - offset);
+    std::memcpy(buf, m.base + offset, n);
+    return n;
+}
+
+// Copy straight into the mapping, growing it first if needed
+void MmapStorage::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    std::unique_lock<std::mutex> g(stateLock);
+    Mapping* m = &map(path);
+    if (offset + len > m->capacity) m = &grow(g, path, offset + len);
+    std::memcpy(m->base + offset, buf, len);
+    m->length = std::max(m->length, offset + len);
+}
+
+// Copy the source mapping into the target mapping
+void MmapStorage::copy(const std::string& source, const std::string& target) {
+    std::unique_lock<std::mutex> g(stateLock);
+    std::size_t needed = map(source).length;
+    Mapping* dst = &map(target, true);
+    if (needed > dst->capacity) dst = &grow(g, target, needed);
+    Mapping& src = map(source);  // looked up again, waiting for the target may have let it be evicted
+    std::memcpy(dst->base, src.base, src.length);
+    dst->length = src.length;
+}
+
+// Reflink the source file once both files are unmapped and trimmed to their logical length
+bool MmapStorage::clone(const std::string& source, const std::string& target) {
+#ifdef FICLONE
+    std::unique_lock<std::mutex> g(stateLock);
+    auto it = findUnpinned(g, source);
+    if (it != maps.end()) unmap(it, true);
+    it = findUnpinned(g, target);
+    if (it != maps.end()) unmap(it, true);
+    auto src = HandlePool::instance().open(source);
+    auto dst = HandlePool::instance().open(target, true);
+    if (::ioctl(dst.fd(), FICLONE, src.fd()) != 0) return false;
+    dst.written();
+    return true;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+// Drop the target's mapping and pooled descriptor under the lock, then copy the host file without holding it
+std::size_t MmapStorage::importFile(const std::string& hostPath, const std::string& path) {
+    {
+        std::unique_lock<std::mutex> g(stateLock);
+        auto it = findUnpinned(g, path);
+        if (it != maps.end()) unmap(it, false);  // the file is replaced, its padding with it
+        HandlePool::instance().close(path);
+    }
+    return copyHostFile(hostPath, path);
+}
+
+// Unmap both paths (trimming the source) and close their descriptors, then rename on disk
+void MmapStorage::rename(const std::string& from, const std::string& to) {
+    std::unique_lock<std::mutex> g(stateLock);
+    auto it = findUnpinned(g, from);
+    if (it != maps.end()) unmap(it, true);
+    it = findUnpinned(g, to);
+    if (it != maps.end()) unmap(it, false);
+    HandlePool::instance().close(from);
+    HandlePool::instance().close(to);
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to rename file: " + from);
+    }
+}
+
+// The mapping knows the logical length
+std::size_t MmapStorage::length(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    return map(path).length;
+}
+
+// Writes through the mapping update the modification time when they fault, so the file on disk is enough
+std::uint64_t MmapStorage::stamp(const std::string& path) {
+    return hostStamp(path);
+}
+
+// Map and pin the file under the lock, then pass the whole mapping as one piece without holding the lock
+void MmapStorage::scan(const std::string& path, const ChunkFn& fn) {
+    std::unique_lock<std::mutex> g(stateLock);
+    Mapping& m = map(path);  // entries are never relocated, and a pinned one is neither moved nor unmapped
+    ++m.pins;
+    const char* base = m.base;
+    std::size_t length = m.length;
+    g.unlock();
+    try {
+        if (length > 0) fn(base, length);
+    } catch (...) {
+        g.lock();
+        unpin(m);
+        throw;
+    }
+    g.lock();
+    unpin(m);
+}
+
+// write() straight out of the pinned mapping, without holding the lock
+bool MmapStorage::sendTo(const std::string& path, int outFd, std::size_t& sent) {
+    std::unique_lock<std::mutex> g(stateLock);
+    Mapping& m = map(path);
+    ++m.pins;
+    const char* base = m.base;
+    std::size_t length = m.length;
+    g.unlock();
+    sent = 0;
+    while (sent < length) {
+        ssize_t n = ::write(outFd, base + sent, length - sent);
+        if (n < 0) {
+            if (retrySend(outFd)) continue;
+            g.lock();
+            unpin(m);
+            throw FileException(FileException::ErrorType::ReadError,
+                                "Failed to send file: " + path);
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    g.lock();
+    unpin(m);
+    return true;
+}
+
+// Shared mappings are already visible to every reader of the file
+void MmapStorage::flushAll() {}
+
+// msync every mapping
+void MmapStorage::syncAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    for (auto& m : maps) ::msync(m.second.base, m.second.length, MS_SYNC);
+}
+
+// Unmap everything and trim the files to their logical length, once no scan or send is left
+void MmapStorage::closeAll() {
+    std::unique_lock<std::mutex> g(stateLock);
+    unpinned.wait(g, [this] {
+        return std::none_of(maps.begin(), maps.end(), [](const auto& e) { return e.second.pins > 0; });
+    });
+    while (!maps.empty()) unmap(maps.begin(), true);
+    HandlePool::instance().closeAll();
+}
+
+// Set the cap used by the backend
+void MmapStorage::setCapacity(std::size_t n) {
+    configuredCapacity = n < 2 ? 2 : n;
+}
+
+// Find or create the mapping of a file
+MmapStorage::Mapping& MmapStorage::map(const std::string& path, bool create) {
+    auto it = maps.find(path);
+    if (it != maps.end()) {
+        recency.splice(recency.begin(), recency, it->second.lru);
+        return it->second;
+    }
+    if (maps.size() >= capacity) evict();
+
+    auto h = HandlePool::instance().open(path, create);
+    struct stat st{};
+    if (::fstat(h.fd(), &st) != 0) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to stat file: " + path);
+    }
+    std::size_t length = static_cast<std::size_t>(st.st_size);
+    std::size_t cap = roundChunk(length);
+    if (cap > length && ::ftruncate(h.fd(), static_cast<off_t>(cap)) != 0) {
+        throw FileException(FileException::ErrorType::WriteError,
+                            "Failed to extend file: " + path);
+    }
+    void* base = ::mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_SHARED, h.fd(), 0);
+    if (base == MAP_FAILED) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Failed to map file: " + path);
+    }
+    recency.push_front(path);
+    Mapping& m = maps[path];
+    m.base = static_cast<char*>(base);
+    m.capacity = cap;
+    m.length = length;
+    m.pins = 0;
+    m.lru = recency.begin();
+    return m;
+}
+
+// Wait while the file's mapping is pinned; it may be unmapped or grown by someone else meanwhile
+std::unordered_map<std::string, MmapStorage::Mapping>::iterator
+MmapStorage::findUnpinned(std::unique_lock<std::mutex>& g, const std::string& path) {
+    auto it = maps.find(path);
+    while (it != maps.end() && it->second.pins > 0) {
+        unpinned.wait(g);
+        it = maps.find(path);
+    }
+    return it;
+}
+
+// Enlarge the file and its mapping, at least doubling so appends stay amortized O(1).
+// A scan or send still reading the old address keeps the mapping where it is until it is done
+MmapStorage::Mapping& MmapStorage::grow(std::unique_lock<std::mutex>& g, const std::string& path,
+                                        std::size_t needed) {
+    auto it = findUnpinned(g, path);
+    Mapping& m = it == maps.end() ? map(path) : it->second;
+    if (needed <= m.capacity) return m;  // grown by someone else while waiting
+    std::size_t cap = roundChunk(std::max(needed, m.capacity * 2));
+    auto h = HandlePool::instance().open(path);
+    if (::ftruncate(h.fd(), static_cast<off_t>(cap)) != 0) {
+        throw FileException(FileException::ErrorType::WriteError,
+                            "Failed to extend file: " + path);
+    }
+#ifdef __linux__
+    void* base = ::mremap(m.base, m.capacity, cap, MREMAP_MAYMOVE);
+#else
+    ::munmap(m.base, m.capacity);
+    void* base = ::mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_SHARED, h.fd(), 0);
+#endif
+    if (base == MAP_FAILED) {
+        throw FileException(FileException::ErrorType::WriteError,
+                            "Failed to remap file: " + path);
+    }
+    m.base = static_cast<char*>(base);
+    m.capacity = cap;
+    return m;
+}
+
+// Unmap the least recently used file that is not pinned
+void MmapStorage::evict() {
+    for (auto it = recency.rbegin(); it != recency.rend(); ++it) {
+        auto m = maps.find(*it);
+        if (m->second.pins > 0) continue;
+        unmap(m, true);
+        return;
+    }
+}
+
+// Unmap a file, optionally trimming the chunk padding
+void MmapStorage::unmap(std::unordered_map<std::string, Mapping>::iterator it, bool trim) {
+    ::munmap(it->second.base, it->second.capacity);
+    if (trim) {
+        auto h = HandlePool::instance().open(it->first);
+        if (::ftruncate(h.fd(), static_cast<off_t>(it->second.length)) != 0) {
+            throw FileException(FileException::ErrorType::WriteError,
+                                "Failed to trim file: " + it->first);
+        }
+    }
+    recency.erase(it->second.lru);
+    maps.erase(it);
+}
+
+// Drop a pin; the lock is held
+void MmapStorage::unpin(Mapping& m) {
+    if (--m.pins == 0) unpinned.notify_all();
+}
@@ -0,0 +1,72 @@
+#ifndef EX1_MMAP_STORAGE_H
+#define EX1_MMAP_STORAGE_H
+
+#include "Storage.h"
+#include <condition_variable>
+#include <list>
+#include <unordered_map>
+
+// MmapStorage class: maps each backing file into memory so reads and writes are plain memcpy.
+// Files are grown in large chunks (the tail beyond the logical length is trimmed when unmapped),
+// and the number of live mappings is capped with LRU eviction. Each call holds the backend's lock,
+// except while a pinned mapping is scanned or sent; a pinned mapping is neither moved nor unmapped.
+class MmapStorage : public Storage {
+private:
+    struct Mapping {
+        char* base;                            // Start of the shared mapping
+        std::size_t capacity;                  // Mapped (and on-disk) size
+        std::size_t length;                    // Logical file length
+        int pins;                              // Scans and sends using the mapping, which keep it in place
+        std::list<std::string>::iterator lru;  // Position in the recency list
+    };
+
+public:
+    MmapStorage();
+    ~MmapStorage() override;
+
+    void create(const std::string& path) override;
+    bool remove(const std::string& path) override;
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) override;
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) override;
+    void copy(const std::string& source, const std::string& target) override;
+    bool clone(const std::string& source, const std::string& target) override;
+    std::size_t importFile(const std::string& hostPath, const std::string& path) override;
+    void rename(const std::string& from, const std::string& to) override;
+    std::size_t length(const std::string& path) override;
+    void scan(const std::string& path, const ChunkFn& fn) override;
+    bool sendTo(const std::string& path, int outFd, std::size_t& sent) override;
+    std::uint64_t stamp(const std::string& path) override;
+    void flushAll() override;
+    void syncAll() override;
+    void closeAll() override;
+
+    // Maximum number of files mapped at once (at least 2) from the time the backend is constructed
+    static void setCapacity(std::size_t maps);
+
+private:
+    // Find or create the mapping of a file, moving it to the front of the LRU list
+    Mapping& map(const std::string& path, bool create = false);
+
+    // Find the mapping of a file once no scan or send uses it; g is released while waiting
+    std::unordered_map<std::string, Mapping>::iterator findUnpinned(std::unique_lock<std::mutex>& g,
+                                                                     const std::string& path);
+
+    // Enlarge the file and its mapping so that at least needed bytes fit, waiting until it is not pinned
+    Mapping& grow(std::unique_lock<std::mutex>& g, const std::string& path, std::size_t needed);
+
+    // Unmap the least recently used file that is not pinned
+    void evict();
+
+    // Unmap a file that is not pinned; trim cuts the chunk padding so the file has its logical length again
+    void unmap(std::unordered_map<std::string, Mapping>::iterator it, bool trim);
+
+    // Drop a pin taken by scan or sendTo, waking anyone waiting to move or unmap the file
+    void unpin(Mapping& m);
+
+    std::unordered_map<std::string, Mapping> maps;  // Live mappings by path
+    std::list<std::string> recency;                 // Most recently used path at the front
+    std::size_t capacity;
+    std::condition_variable unpinned;               // Signalled when a mapping loses its last pin
+};
+
+#endif //EX1_MMAP_STORAGE_H
@@ -0,0 +1,126 @@
+#ifndef EX1_NODE_POOL_H
+#define EX1_NODE_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Template class holding fixed-size nodes in large slabs.
+// Nodes never move once allocated, freed nodes are reused through a free list,
+// and once every node is freed the slabs are released at once (all but the first).
+template<std::size_t Size, std::size_t Align>
+class NodePool
+{
+private:
+    union Slot {
+        Slot* next;                              // Next free slot while unused
+        alignas(Align) unsigned char node[Size]; // Storage for one node while in use
+    };
+
+    static constexpr std::size_t FIRST_SLAB = 64;  // Slots in the first slab
+    static constexpr std::size_t MAX_SLAB = 4096;  // Slabs grow by doubling up to this many slots
+
+    std::vector<Slot*> slabs;  // Every slab allocated so far, the current one last
+    std::size_t slabSize;      // Slots in the current slab
+    std::size_t used;          // Slots handed out from the current slab
+    Slot* freeList;            // Freed slots ready for reuse
+    std::size_t live;          // Nodes currently allocated
+
+    NodePool() : slabSize(0), used(0), freeList(nullptr), live(0) {}
+
+    // Drop every slab but the first one
+    void release();
+
+public:
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    // Frees all slabs
+    ~NodePool();
+
+    // Returns the process-wide pool for this node size
+    static NodePool& instance() { static NodePool pool; return pool; }
+
+    // Returns storage for one node
+    void* allocate();
+
+    // Returns a node's storage to the pool
+    void deallocate(void* p);
+
+    // Number of nodes currently allocated
+    std::size_t size() const { return live; }
+};
+
+// Template class: standard allocator that takes single nodes from the matching NodePool
+template<class T>
+class NodeAllocator
+{
+public:
+    typedef T value_type;
+
+    NodeAllocator() = default;
+    template<class U> NodeAllocator(const NodeAllocator<U>&) {}
+
+    // Single objects (list nodes) come from the pool, arrays from the heap
+    T* allocate(std::size_t n) {
+        if (n == 1) return static_cast<T*>(NodePool<sizeof(T), alignof(T)>::instance().allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (n == 1) NodePool<sizeof(T), alignof(T)>::instance().deallocate(p);
+        else ::operator delete(p);
+    }
+
+    template<class U> bool operator==(const NodeAllocator<U>&) const { return true; }
+    template<class U> bool operator!=(const NodeAllocator<U>&) const { return false; }
+};
+
+// Returns storage for one node, reusing a freed slot when there is one
+template<std::size_t Size, std::size_t Align>
+void* NodePool<Size, Align>::allocate()
+{
+    ++live;
+    if (freeList) {
+        Slot* s = freeList;
+        freeList = s->next;
+        return s;
+    }
+    if (slabs.empty() || used == slabSize) {
+        slabSize = slabs.empty() ? FIRST_SLAB : (slabSize < MAX_SLAB ? slabSize * 2 : MAX_SLAB);
+        slabs.push_back(static_cast<Slot*>(::operator new(slabSize * sizeof(Slot))));
+        used = 0;
+    }
+    return &slabs.back()[used++];
+}
+
+// Returns a node's storage to the pool; the last one out releases the slabs
+template<std::size_t Size, std::size_t Align>
+void NodePool<Size, Align>::deallocate(void* p)
+{
+    Slot* s = static_cast<Slot*>(p);
+    s->next = freeList;
+    freeList = s;
+    if (--live == 0) release();
+}
+
+// Drop every slab but the first one, the pool starts over from an empty first slab
+template<std::size_t Size, std::size_t Align>
+void NodePool<Size, Align>::release()
+{
+    if (slabs.empty()) return;
+    for (std::size_t i = 1; i < slabs.size(); ++i) ::operator delete(slabs[i]);
+    slabs.resize(1);
+    slabSize = FIRST_SLAB;
+    used = 0;
+    freeList = nullptr;
+}
+
+// Frees all slabs
+template<std::size_t Size, std::size_t Align>
+NodePool<Size, Align>::~NodePool()
+{
+    for (Slot* slab : slabs) ::operator delete(slab);
+}
+
+#endif //EX1_NODE_POOL_H
@@ -0,0 +1,65 @@
+#include "OutputBuffer.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+// Constructor: the whole block is the put area
+OutputBuffer::OutputBuffer(int fd, std::size_t capacity, std::size_t threshold)
+        : fd(fd), block(capacity ? capacity : 1), threshold(threshold) {
+    setp(block.data(), block.data() + block.size());
+}
+
+// Destructor: writes out whatever is still buffered
+OutputBuffer::~OutputBuffer() {
+    drain();
+}
+
+// Write everything buffered to the descriptor
+void OutputBuffer::drain() {
+    std::size_t pending = static_cast<std::size_t>(pptr() - pbase());
+    if (pending > 0) writeAll(pbase(), pending);
+    setp(block.data(), block.data() + block.size());
+}
+
+// Block is full: write it out and keep the character
+OutputBuffer::int_type OutputBuffer::overflow(int_type ch) {
+    drain();
+    if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+// Copy into the block; data larger than the block bypasses it
+std::streamsize OutputBuffer::xsputn(const char* s, std::streamsize n) {
+    std::size_t len = static_cast<std::size_t>(n);
+    if (len > static_cast<std::size_t>(epptr() - pptr())) {
+        drain();
+        if (len >= block.size()) {
+            writeAll(s, len);
+            return n;
+        }
+    }
+    std::memcpy(pptr(), s, len);
+    pbump(static_cast<int>(len));
+    return n;
+}
+
+// Stream flush (std::endl): only write once enough has accumulated
+int OutputBuffer::sync() {
+    if (static_cast<std::size_t>(pptr() - pbase()) >= threshold) drain();
+    return 0;
+}
+
+// write() the whole range, retrying short writes
+void OutputBuffer::writeAll(const char* data, std::size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;  // nowhere to report it, the output is gone
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef EX1_OUTPUT_BUFFER_H
+#define EX1_OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <streambuf>
+#include <vector>
+
+// OutputBuffer class: stream buffer that collects output in one large block and writes it
+// to a descriptor only when the block fills up, the threshold is crossed at a flush, or drain() is called.
+// std::endl / flush() below the threshold cost nothing, so per-line flushing disappears.
+class OutputBuffer : public std::streambuf {
+public:
+    // Buffer capacity bytes for fd; flushes requested by the stream are honoured only past threshold bytes
+    explicit OutputBuffer(int fd, std::size_t capacity = 1 << 20, std::size_t threshold = 1 << 19);
+
+    // Destructor: writes out whatever is still buffered
+    ~OutputBuffer() override;
+
+    // Write everything buffered to the descriptor
+    void drain();
+
+    // Descriptor the buffer writes to
+    int descriptor() const { return fd; }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    // write() the whole range, retrying short writes
+    void writeAll(const char* data, std::size_t len);
+
+    int fd;
+    std::vector<char> block;
+    std::size_t threshold;
+};
+
+#endif //EX1_OUTPUT_BUFFER_H
@@ -0,0 +1,199 @@
+#include "PageCache.h"
+#include "HandlePool.h"
+#include "FileException.h"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+// Default cache size in pages (4 MiB)
+static const std::size_t DEFAULT_CAPACITY = 1024;
+
+const std::size_t PageCache::PAGE_SIZE;
+const std::size_t PageCache::BYPASS_THRESHOLD;
+
+PageCache::PageCache() : capacity(DEFAULT_CAPACITY), dirtyCount(0), stats() {}
+
+// Destructor: last chance to write back pages the process did not flush
+PageCache::~PageCache() {
+    try {
+        flushAll();
+    } catch (const FileException&) {
+        // the backing file is gone, nothing left to save
+    }
+}
+
+// Returns the process-wide cache
+PageCache& PageCache::instance() {
+    static PageCache cache;
+    return cache;
+}
+
+// Copy up to len bytes at offset into buf
+std::size_t PageCache::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    if (len >= BYPASS_THRESHOLD) {
+        flushRange(path, offset, len, false);
+        ++stats.bypasses;
+        auto h = HandlePool::instance().open(path);
+        ssize_t n = ::pread(h.fd(), buf, len, static_cast<off_t>(offset));
+        if (n < 0) {
+            throw FileException(FileException::ErrorType::ReadError,
+                                "Failed to read from file: " + path);
+        }
+        return static_cast<std::size_t>(n);
+    }
+    std::size_t done = 0;
+    while (done < len) {
+        std::size_t pos = offset + done;
+        Page& page = fetch(path, pos / PAGE_SIZE);
+        std::size_t inPage = pos % PAGE_SIZE;
+        if (inPage >= page.length) break;  // end of file
+        std::size_t n = std::min(len - done, page.length - inPage);
+        std::memcpy(buf + done, page.data.data() + inPage, n);
+        done += n;
+        if (page.length < PAGE_SIZE) break;  // short page is the last one
+    }
+    return done;
+}
+
+// Copy len bytes from buf into the file at offset
+void PageCache::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    if (len >= BYPASS_THRESHOLD) {
+        flushRange(path, offset, len, false);  // partially covered edge pages must not be lost
+        ++stats.bypasses;
+        auto h = HandlePool::instance().open(path);
+        if (::pwrite(h.fd(), buf, len, static_cast<off_t>(offset)) != static_cast<ssize_t>(len)) {
+            throw FileException(FileException::ErrorType::WriteError,
+                                "Failed to write to file: " + path);
+        }
+        h.written();
+        flushRange(path, offset, len, true);
+        return;
+    }
+    std::size_t done = 0;
+    while (done < len) {
+        std::size_t pos = offset + done;
+        Page& page = fetch(path, pos / PAGE_SIZE);
+        std::size_t inPage = pos % PAGE_SIZE;
+        std::size_t n = std::min(len - done, PAGE_SIZE - inPage);
+        std::memcpy(page.data.data() + inPage, buf + done, n);
+        page.length = std::max(page.length, inPage + n);
+        if (!page.dirty) {
+            page.dirty = true;
+            ++dirtyCount;
+        }
+        done += n;
+    }
+}
+
+// Write back the dirty pages of one file
+void PageCache::flush(const std::string& path) {
+    auto it = files.find(path);
+    if (it == files.end()) return;
+    for (auto& p : it->second) {
+        if (p.second->dirty) writeBack(*p.second);
+    }
+}
+
+// Write back every dirty page
+void PageCache::flushAll() {
+    for (auto& page : lru) {
+        if (page.dirty) writeBack(page);
+    }
+}
+
+// Drop the pages of one file without writing them
+void PageCache::invalidate(const std::string& path) {
+    auto it = files.find(path);
+    if (it == files.end()) return;
+    for (auto& p : it->second) {
+        if (p.second->dirty) --dirtyCount;
+        lru.erase(p.second);
+    }
+    files.erase(it);
+}
+
+// Change the cap; shrinking evicts immediately
+void PageCache::setCapacity(std::size_t pages) {
+    capacity = pages < 1 ? 1 : pages;
+    while (lru.size() > capacity) evict();
+}
+
+// Find or load the page, moving it to the front of the LRU list
+PageCache::Page& PageCache::fetch(const std::string& path, std::size_t index) {
+    auto fit = files.find(path);
+    if (fit != files.end()) {
+        auto pit = fit->second.find(index);
+        if (pit != fit->second.end()) {
+            ++stats.hits;
+            lru.splice(lru.begin(), lru, pit->second);
+            return *pit->second;
+        }
+    }
+    ++stats.misses;
+    if (lru.size() >= capacity) {
+        evict();
+        fit = files.find(path);  // eviction may have dropped the file's last page
+    }
+    if (fit == files.end()) fit = files.emplace(path, FilePages()).first;
+
+    Page page;
+    page.path = &fit->first;
+    page.index = index;
+    page.dirty = false;
+    page.data.resize(PAGE_SIZE);
+    auto h = HandlePool::instance().open(path);
+    ssize_t n = ::pread(h.fd(), page.data.data(), PAGE_SIZE, static_cast<off_t>(index * PAGE_SIZE));
+    if (n < 0) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to read from file: " + path);
+    }
+    page.length = static_cast<std::size_t>(n);
+    lru.push_front(std::move(page));
+    fit->second[index] = lru.begin();
+    return lru.front();
+}
+
+// Write back (and optionally drop) the cached pages overlapping [offset, offset + len)
+void PageCache::flushRange(const std::string& path, std::size_t offset, std::size_t len, bool drop) {
+    auto fit = files.find(path);
+    if (fit == files.end() || len == 0) return;
+    std::size_t first = offset / PAGE_SIZE, last = (offset + len - 1) / PAGE_SIZE;
+    for (std::size_t i = first; i <= last; ++i) {
+        auto pit = fit->second.find(i);
+        if (pit == fit->second.end()) continue;
+        if (drop) {
+            if (pit->second->dirty) --dirtyCount;
+            lru.erase(pit->second);
+            fit->second.erase(pit);
+        } else if (pit->second->dirty) {
+            writeBack(*pit->second);
+        }
+    }
+    if (fit->second.empty()) files.erase(fit);
+}
+
+// Write a dirty page back to its file
+void PageCache::writeBack(Page& page) {
+    auto h = HandlePool::instance().open(*page.path);
+    ssize_t n = ::pwrite(h.fd(), page.data.data(), page.length, static_cast<off_t>(page.index * PAGE_SIZE));
+    if (n != static_cast<ssize_t>(page.length)) {
+        throw FileException(FileException::ErrorType::WriteError,
+                            "Failed to write to file: " + *page.path);
+    }
+    h.written();
+    page.dirty = false;
+    --dirtyCount;
+    ++stats.writebacks;
+}
+
+// Remove the least recently used page, writing it back first if dirty
+void PageCache::evict() {
+    if (lru.empty()) return;
+    Page& victim = lru.back();
+    if (victim.dirty) writeBack(victim);
+    auto fit = files.find(*victim.path);
+    fit->second.erase(victim.index);
+    lru.pop_back();
+    if (fit->second.empty()) files.erase(fit);
+    ++stats.evictions;
+}
@@ -0,0 +1,97 @@
+#ifndef EX1_PAGE_CACHE_H
+#define EX1_PAGE_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// PageCache class: process-wide write-back cache of fixed-size file pages with LRU eviction.
+// Dirty pages reach the backing file only when they are evicted or flushed.
+class PageCache {
+public:
+    static const std::size_t PAGE_SIZE = 4096;
+
+    // Transfers at least this large bypass the cache and use a single positioned syscall
+    static const std::size_t BYPASS_THRESHOLD = 16 * PAGE_SIZE;
+
+    // Counters used to size the cache
+    struct Stats {
+        std::size_t hits;        // Page accesses served from memory
+        std::size_t misses;      // Page accesses that had to read the backing file
+        std::size_t writebacks;  // Dirty pages written to the backing file
+        std::size_t evictions;   // Pages dropped to make room
+        std::size_t bypasses;    // Large transfers that went straight to the backing file
+    };
+
+private:
+    struct Page {
+        const std::string* path;  // Key of the owning file entry
+        std::size_t index;        // Page number within the file
+        std::size_t length;       // Valid bytes in data (less than PAGE_SIZE only for the last page)
+        bool dirty;               // Modified since it was loaded or written back
+        std::vector<char> data;
+    };
+    typedef std::list<Page>::iterator PageRef;
+    typedef std::unordered_map<std::size_t, PageRef> FilePages;
+
+public:
+    // Returns the process-wide cache
+    static PageCache& instance();
+
+    // Copy up to len bytes at offset into buf; returns the number of bytes read (short at end of file).
+    // Large reads write back the overlapping dirty pages and issue one pread.
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len);
+
+    // Copy len bytes from buf into the file at offset, marking the touched pages dirty.
+    // Large writes issue one pwrite and drop the overlapping pages.
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len);
+
+    // Write back the dirty pages of one file
+    void flush(const std::string& path);
+
+    // Write back every dirty page
+    void flushAll();
+
+    // Drop the pages of one file without writing them (file deleted or overwritten on disk)
+    void invalidate(const std::string& path);
+
+    // Maximum number of cached pages (at least 1)
+    void setCapacity(std::size_t pages);
+    std::size_t getCapacity() const { return capacity; }
+
+    // Number of cached pages and how many of them are dirty
+    std::size_t size() const { return lru.size(); }
+    std::size_t dirtyPages() const { return dirtyCount; }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+private:
+    PageCache();
+    ~PageCache();
+
+    // Find or load the page, moving it to the front of the LRU list
+    Page& fetch(const std::string& path, std::size_t index);
+
+    // Write back (and optionally drop) the cached pages overlapping [offset, offset + len)
+    void flushRange(const std::string& path, std::size_t offset, std::size_t len, bool drop);
+
+    // Write a dirty page back to its file
+    void writeBack(Page& page);
+
+    // Remove the least recently used page, writing it back first if dirty
+    void evict();
+
+    std::unordered_map<std::string, FilePages> files;  // Cached pages by file and page number
+    std::list<Page> lru;                               // Most recently used page at the front
+    std::size_t capacity;
+    std::size_t dirtyCount;
+    Stats stats;
+};
+
+#endif //EX1_PAGE_CACHE_H
@@ -0,0 +1,47 @@
+#include "Path.h"
+
+// Parse a user path, joining its non-empty components with '#': "V/p/q/" and "V//p/q" are both "V#p#q",
+// so no stored name ends in an empty component
+Path::Path(std::string_view userPath) {
+    text.reserve(userPath.size());
+    for (char c : userPath) {
+        if (c != '/' && c != '#') text += c;
+        else if (!text.empty() && text.back() != '#') text += '#';
+    }
+    if (!text.empty() && text.back() == '#') text.pop_back();
+    parse();
+}
+
+// Copy constructor: the views must point into the new copy of the text
+Path::Path(const Path& rhs) : text(rhs.text) {
+    parse();
+}
+
+// Assignment operator: re-parse so the views point into our own text
+Path& Path::operator=(const Path& rhs) {
+    if (this != &rhs) {
+        text = rhs.text;
+        parse();
+    }
+    return *this;
+}
+
+// Split text into its non-empty components
+void Path::parse() {
+    parts.clear();
+    std::string_view rest(text);
+    while (!rest.empty()) {
+        std::size_t cut = rest.find('#');
+        std::string_view part = rest.substr(0, cut);
+        if (!part.empty()) parts.push_back(part);
+        if (cut == std::string_view::npos) break;
+        rest.remove_prefix(cut + 1);
+    }
+}
+
+// Last component of an internal file name
+std::string_view Path::leaf(const std::string& internalName) {
+    std::string_view name(internalName);
+    std::size_t cut = name.find_last_of('#');
+    return cut == std::string_view::npos ? name : name.substr(cut + 1);
+}
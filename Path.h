@@ -0,0 +1,43 @@
+#ifndef EX1_PATH_H
+#define EX1_PATH_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Path class: a user path parsed once per command.
+// Holds the internal form (the non-empty components joined by '#', the name used for backing files)
+// and views of the components, which point into that internal string.
+class Path {
+private:
+    std::string text;                    // Internal form of the path
+    std::vector<std::string_view> parts; // Components, viewing text
+
+    // Split text into parts
+    void parse();
+
+public:
+    // Parse a user path such as "V/tmp/f.cc" (an internal "V#tmp#f.cc" is accepted too)
+    explicit Path(std::string_view userPath);
+
+    Path(const Path& rhs);
+    Path& operator=(const Path& rhs);
+
+    // Internal form, e.g. "V#tmp#f.cc" (never ends in '#')
+    const std::string& internal() const { return text; }
+
+    // Number of components
+    std::size_t size() const { return parts.size(); }
+    bool empty() const { return parts.empty(); }
+
+    // Component access
+    std::string_view operator[](std::size_t i) const { return parts[i]; }
+    std::string_view front() const { return parts.front(); }
+    std::string_view back() const { return parts.back(); }
+
+    // Last component of an internal file name ("V#tmp#f.cc" -> "f.cc")
+    static std::string_view leaf(const std::string& internalName);
+};
+
+#endif //EX1_PATH_H
@@ -1,34 +1,44 @@
 #include "RCObject.h"
 
 // Assignment operator does nothing, simply returns the current object (no-op)
-RCObject& RCObject::operator=(const RCObject&) {
+template<class Count>
+RCObject<Count>& RCObject<Count>::operator=(const RCObject&) {
     return *this;
 }
 
 // Increments the reference count when a new reference to the object is made
-void RCObject::addReference(){
-    ++refCount;
+template<class Count>
+void RCObject<Count>::addReference() noexcept {
+    refCount.increment();
 }
 
 // Decrements the reference count and deletes the object if the count reaches zero
-void RCObject::removeReference(){
-    if(--refCount == 0) delete this;
+template<class Count>
+void RCObject<Count>::removeReference() noexcept {
+    if (refCount.decrement()) delete this;
 }
 
 // Marks the object as unshareable, meaning it can no longer be shared
-void RCObject::markUnshareable(){
-    shareable = false;
+template<class Count>
+void RCObject<Count>::markUnshareable() {
+    shareable.store(false, std::memory_order_relaxed);
 }
 
 // Returns true if the object is shareable (can be referenced by more than one owner)
-bool RCObject::isShareable() const {
-    return shareable;
+template<class Count>
+bool RCObject<Count>::isShareable() const {
+    return shareable.load(std::memory_order_relaxed);
 }
 
 // Default destructor does nothing (necessary for polymorphic behavior)
-RCObject::~RCObject() = default;
+template<class Count>
+RCObject<Count>::~RCObject() = default;
 
 // Returns true if the object is shared (more than one reference exists)
-bool RCObject::isShared() const {
-    return refCount > 1;
+template<class Count>
+bool RCObject<Count>::isShared() const {
+    return refCount.load() > 1;
 }
+
+template class RCObject<PlainCount>;
+template class RCObject<AtomicCount>;
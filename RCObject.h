@@ -1,14 +1,41 @@
 #ifndef EX1_RCOBJECT_H
 #define EX1_RCOBJECT_H
 
-// Class representing a reference-counted object
+#include <atomic>
+
+// Reference count policy for objects used by one thread only: a plain int
+class PlainCount {
+private:
+    int count = 0;
+public:
+    void increment() noexcept { ++count; }
+    // Returns true when the last reference is gone
+    bool decrement() noexcept { return --count == 0; }
+    int load() const noexcept { return count; }
+};
+
+// Reference count policy for objects shared between threads.
+// Increments are relaxed (a new reference is always made from an existing one); decrements are acquire/release,
+// so whoever drops the last reference sees every write made through the others before deleting the object
+class AtomicCount {
+private:
+    std::atomic<int> count{0};
+public:
+    void increment() noexcept { count.fetch_add(1, std::memory_order_relaxed); }
+    // Returns true when the last reference is gone
+    bool decrement() noexcept { return count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+    int load() const noexcept { return count.load(std::memory_order_relaxed); }
+};
+
+// Template class representing a reference-counted object; Count selects how the count is kept
+template<class Count = AtomicCount>
 class RCObject {
 protected:
     // Constructor initializes reference count to 0 and marks object as shareable
-    RCObject() : refCount(0), shareable(true) {}
+    RCObject() : shareable(true) {}
 
     // Copy constructor initializes reference count to 0 and marks object as shareable
-    RCObject(const RCObject&) : refCount(0), shareable(true) {}
+    RCObject(const RCObject&) : shareable(true) {}
 
     // Assignment operator (does nothing in this case)
     RCObject& operator=(const RCObject&);
@@ -18,10 +45,10 @@ protected:
 
 public:
     // Increments the reference count when a new reference to the object is made
-    void addReference();
+    void addReference() noexcept;
 
     // Decrements the reference count and deletes the object if the count reaches zero
-    void removeReference();
+    void removeReference() noexcept;
 
     // Marks the object as unshareable (it cannot be shared anymore)
     void markUnshareable();
@@ -33,11 +60,15 @@ public:
     bool isShared() const;
 
     // Returns the current reference count
-    int getRefCount() const { return refCount; }
+    int getRefCount() const { return refCount.load(); }
 
 private:
-    int refCount;  // Keeps track of the number of references to this object
-    bool shareable;  // Indicates whether the object can be shared
+    Count refCount;  // Keeps track of the number of references to this object
+    std::atomic<bool> shareable;  // Indicates whether the object can be shared
 };
 
+// Both policies are instantiated once, in RCObject.cpp
+extern template class RCObject<PlainCount>;
+extern template class RCObject<AtomicCount>;
+
 #endif //EX1_RCOBJECT_H
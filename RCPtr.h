@@ -1,6 +1,8 @@
 #ifndef EX1_RCPTR_H
 #define EX1_RCPTR_H
 
+#include <utility>
+
 // Template class representing a reference-counted smart pointer
 template<class T>
 class RCPtr
@@ -18,12 +20,21 @@ public:
     // Copy constructor, shares the same pointee and manages the reference count
     RCPtr(const RCPtr& rhs) : pointee(rhs.pointee) { init(); }
 
+    // Move constructor, takes over rhs's reference without touching the count
+    RCPtr(RCPtr&& rhs) noexcept : pointee(rhs.pointee) { rhs.pointee = nullptr; }
+
     // Destructor, removes reference from the pointee if it's not null
     ~RCPtr() { if (pointee) pointee->removeReference(); }
 
     // Assignment operator that manages reference count correctly
     RCPtr& operator=(const RCPtr& rhs);
 
+    // Move assignment, takes over rhs's reference and drops the old one
+    RCPtr& operator=(RCPtr&& rhs) noexcept;
+
+    // Exchange pointees without touching either count
+    void swap(RCPtr& rhs) noexcept { std::swap(pointee, rhs.pointee); }
+
     // Access the pointee using -> operator
     T* operator->() const { return pointee; }
 
@@ -60,4 +71,19 @@ RCPtr<T>& RCPtr<T>::operator=(const RCPtr<T>& rhs)
     return *this;
 }
 
+// Move assignment, the old pointee loses its reference when the temporary goes away
+template<class T>
+RCPtr<T>& RCPtr<T>::operator=(RCPtr<T>&& rhs) noexcept
+{
+    RCPtr<T>(std::move(rhs)).swap(*this);
+    return *this;
+}
+
+// Non-member swap, found by argument-dependent lookup
+template<class T>
+void swap(RCPtr<T>& a, RCPtr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
 #endif //EX1_RCPTR_H
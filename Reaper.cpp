@@ -0,0 +1,162 @@
+#include "Reaper.h"
+#include "FileException.h"
+#include "FolderWalk.h"
+#include "Storage.h"
+#include <vector>
+
+const std::size_t Reaper::BATCH;
+
+// Start the thread; it sleeps until the first job
+Reaper::Reaper() : stopping(false), queued(0), pending(0), removed(0), worker(&Reaper::run, this) {}
+
+// Trees drain the queue before they go, so only the thread is left to stop
+Reaper::~Reaper() {
+    {
+        std::lock_guard<std::mutex> g(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+// Returns the process-wide reaper
+Reaper& Reaper::instance() {
+    static Reaper reaper;
+    return reaper;
+}
+
+// Splice the folder's node into a new job
+void Reaper::submit(Folder::FolderList& list, Folder::FolderList::iterator slot, std::string prefix,
+                    std::size_t files, std::shared_mutex& structure) {
+    std::list<Job> one(1);
+    Job& job = one.front();
+    job.folders.splice(job.folders.end(), list, slot);
+    job.prefix = std::move(prefix);
+    job.count = files;
+    job.structure = &structure;
+    enqueue(one);
+}
+
+// Splice every child of the root into a new job and clear the root's indexes
+void Reaper::submitAll(Folder& root, std::shared_mutex& structure) {
+    std::list<Job> one(1);
+    Job& job = one.front();
+    job.folders.splice(job.folders.end(), root.subfolders);
+    job.files.splice(job.files.end(), root.files);
+    job.prefix = root.foldername + '#';
+    job.count = root.fileIndex.size();
+    job.structure = &structure;
+    root.subfolderIndex.clear();
+    root.fileNames.clear();
+    root.fileIndex.clear();
+    enqueue(one);
+}
+
+// Paths claimed under the new prefix belong to the job now and must go with it
+void Reaper::enqueue(std::list<Job>& one) {
+    Job& job = one.front();
+    {
+        std::lock_guard<std::mutex> g(lock);
+        for (auto it = claimed.begin(); it != claimed.end();) {
+            if (it->compare(0, job.prefix.size(), job.prefix) == 0) it = claimed.erase(it);
+            else ++it;
+        }
+        ++prefixes[job.prefix];
+        pending += job.count;
+        ++queued;
+        jobs.splice(jobs.end(), one);
+    }
+    wake.notify_one();
+}
+
+// Cheap while the queue is empty; otherwise checks each folder prefix of the path
+void Reaper::claim(const std::string& path) {
+    if (queued.load(std::memory_order_acquire) == 0) return;
+    std::lock_guard<std::mutex> g(lock);
+    if (prefixes.empty() || claimed.count(path)) return;
+    for (std::size_t i = path.find('#'); i != std::string::npos; i = path.find('#', i + 1)) {
+        if (!prefixes.count(path.substr(0, i + 1))) continue;
+        claimed.insert(path);
+        try {
+            Storage::get().remove(path);
+        } catch (const FileException&) {
+            // nothing there to take over
+        }
+        return;
+    }
+}
+
+// Block until every detached subtree is gone
+void Reaper::drain() {
+    std::unique_lock<std::mutex> g(lock);
+    idle.wait(g, [this] { return jobs.empty(); });
+}
+
+Reaper::Stats Reaper::getStats() const {
+    return Stats{queued.load(), pending.load(), removed.load()};
+}
+
+// The front job stays queued (and its prefix claimable) until its nodes are freed
+void Reaper::run() {
+    std::unique_lock<std::mutex> g(lock);
+    for (;;) {
+        wake.wait(g, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) return;
+        Job& job = jobs.front();
+        g.unlock();
+        removeFiles(job);
+        {
+            std::unique_lock<std::shared_mutex> tree(*job.structure);
+            job.folders.clear();  // every file is detached from its backing file, so this only frees memory
+            job.files.clear();
+        }
+        g.lock();
+        auto it = prefixes.find(job.prefix);
+        if (--it->second == 0) prefixes.erase(it);
+        jobs.pop_front();
+        --queued;
+        if (jobs.empty()) {
+            claimed.clear();
+            idle.notify_all();
+        }
+    }
+}
+
+// Nobody else can reach the folders any more; the ones never read from a snapshot have no files to remove
+void Reaper::removeFiles(Job& job) {
+    std::vector<FileManager*> batch;
+    batch.reserve(BATCH);
+    auto add = [&](Folder::FileList& files) {
+        for (auto& fm : files) {
+            batch.push_back(&fm);
+            if (batch.size() == BATCH) removeBatch(batch, job);
+        }
+    };
+    add(job.files);
+    FolderWalk<Folder> walk(FolderWalk<Folder>::DepthFirst, SIZE_MAX, false);
+    for (auto& top : job.folders) {
+        walk.start(top);
+        while (Folder* f = walk.next()) add(f->files);
+    }
+    removeBatch(batch, job);
+}
+
+// A claimed path belongs to a newer file: only let go of the old value
+void Reaper::removeBatch(std::vector<FileManager*>& batch, Job& job) {
+    std::lock_guard<std::mutex> g(lock);
+    for (FileManager* fm : batch) {
+        const std::string& name = fm->getFileName();
+        if (!claimed.count(name)) {
+            try {
+                Storage::get().remove(name);
+            } catch (const FileException&) {
+                // left on disk rather than retried; the tree no longer knows the file
+            }
+        }
+        *fm = FileManager();  // freeing the node later must not touch the path again
+        ++removed;
+        --pending;
+        --job.count;
+    }
+    batch.clear();
+}
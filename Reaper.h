@@ -0,0 +1,92 @@
+#ifndef EX1_REAPER_H
+#define EX1_REAPER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "Folder.h"
+
+// Reaper class: process-wide background thread deleting what rmdir and teardown cut out of a tree.
+// The detached folders arrive as list nodes spliced out of their parent in O(1). The reaper removes their
+// backing files in batches without any tree lock, then frees the nodes under the tree's structure lock
+// (the node pools are not thread-safe). A file created at a path that is still waiting to be removed
+// claims the path: its stale backing file goes at once and the reaper leaves the path alone.
+class Reaper {
+public:
+    // Backing files removed per batch; claims wait for at most one batch
+    static const std::size_t BATCH = 64;
+
+    // Queue depth, readable at any time
+    struct Stats {
+        std::size_t queued;   // Detached subtrees not finished yet
+        std::size_t pending;  // Files in them still to be removed
+        std::size_t removed;  // Files removed since the process started
+    };
+
+    // Returns the process-wide reaper
+    static Reaper& instance();
+
+    // Take over the folder at slot of list, holding files files below the internal path prefix ("V#a#").
+    // The caller holds structure exclusively
+    void submit(Folder::FolderList& list, Folder::FolderList::iterator slot, std::string prefix,
+                std::size_t files, std::shared_mutex& structure);
+
+    // Take over everything below root, leaving it empty; used at teardown
+    void submitAll(Folder& root, std::shared_mutex& structure);
+
+    // A file is being created at the internal path: remove a stale backing file still waiting there
+    void claim(const std::string& path);
+
+    // Block until every detached subtree is gone
+    void drain();
+
+    Stats getStats() const;
+
+    Reaper(const Reaper&) = delete;
+    Reaper& operator=(const Reaper&) = delete;
+
+private:
+    struct Job {
+        Folder::FolderList folders;    // Detached folders
+        Folder::FileList files;        // Detached files outside those folders (teardown only)
+        std::string prefix;            // Internal path every file of the job starts with
+        std::size_t count;             // Files still to be removed
+        std::shared_mutex* structure;  // Lock of the tree the nodes came from
+    };
+
+    Reaper();
+    ~Reaper();
+
+    // Queue a filled job and wake the thread
+    void enqueue(std::list<Job>& one);
+
+    // Thread loop: take the oldest job, remove its files, free its nodes
+    void run();
+
+    // Remove the backing files of every file below the job, batch by batch
+    void removeFiles(Job& job);
+
+    // Remove one batch under the lock, skipping claimed paths
+    void removeBatch(std::vector<FileManager*>& batch, Job& job);
+
+    mutable std::mutex lock;                               // Guards the fields below and orders claims with removals
+    std::condition_variable wake;                          // Signalled when a job is queued or the reaper stops
+    std::condition_variable idle;                          // Signalled when the queue empties
+    std::list<Job> jobs;                                   // Oldest first; the thread works on the front
+    std::unordered_map<std::string, std::size_t> prefixes; // Prefixes of queued jobs, with their number
+    std::unordered_set<std::string> claimed;               // Paths taken over by new files while queued
+    bool stopping;
+    std::atomic<std::size_t> queued;
+    std::atomic<std::size_t> pending;
+    std::atomic<std::size_t> removed;
+    std::thread worker;
+};
+
+#endif //EX1_REAPER_H
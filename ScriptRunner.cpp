@@ -0,0 +1,81 @@
+#include "ScriptRunner.h"
+#include "OutputBuffer.h"
+#include "Terminal.h"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ScriptRunner::ScriptRunner(Terminal& terminal) : terminal(terminal) {}
+
+// Run every line of the script
+int ScriptRunner::run(const char* path) {
+    errors.clear();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "ERROR: cannot open script " << path << std::endl;
+        return 1;
+    }
+    struct stat st{};
+    ::fstat(fd, &st);
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    const char* data = nullptr;
+    if (size > 0) {
+        void* m = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            ::close(fd);
+            std::cerr << "ERROR: cannot map script " << path << std::endl;
+            return 1;
+        }
+        ::madvise(m, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(m);
+    }
+    ::close(fd);
+
+    // Redirect the terminal's output into one large buffer and its errors into a collector
+    std::cout.flush();
+    OutputBuffer out(STDOUT_FILENO);
+    std::stringbuf err;
+    std::streambuf* oldOut = std::cout.rdbuf(&out);
+    std::streambuf* oldErr = std::cerr.rdbuf(&err);
+
+    int failedLines = 0;
+    std::size_t lineNo = 0;
+    std::size_t pos = 0;
+    while (pos < size && terminal.isRunning()) {
+        const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        std::size_t end = nl ? static_cast<std::size_t>(nl - data) : size;
+        ++lineNo;
+        terminal.executeCommand(std::string_view(data + pos, end - pos));
+        if (err.in_avail() > 0) {
+            collect(lineNo, err.str());
+            err.str(std::string());
+            ++failedLines;
+        }
+        pos = end + 1;
+    }
+
+    out.drain();
+    std::cout.rdbuf(oldOut);
+    std::cerr.rdbuf(oldErr);
+    if (data) ::munmap(const_cast<char*>(data), size);
+
+    for (const auto& e : errors) std::cerr << e << '\n';
+    std::cerr.flush();
+    return failedLines;
+}
+
+// Record each message a line wrote to std::cerr
+void ScriptRunner::collect(std::size_t lineNo, const std::string& text) {
+    std::size_t start = 0;
+    while (start < text.size()) {
+        std::size_t nl = text.find('\n', start);
+        if (nl == std::string::npos) nl = text.size();
+        if (nl > start) errors.push_back("line " + std::to_string(lineNo) + ": " + text.substr(start, nl - start));
+        start = nl + 1;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef EX1_SCRIPT_RUNNER_H
+#define EX1_SCRIPT_RUNNER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Terminal;
+
+// ScriptRunner class: non-interactive batch mode.
+// Maps a script file, runs its lines back-to-back on a Terminal, buffers standard output
+// in large blocks and collects error messages with their line numbers for a report at the end.
+class ScriptRunner {
+public:
+    explicit ScriptRunner(Terminal& terminal);
+
+    // Run every line of the script (stops early at 'exit'); returns the number of lines that reported errors
+    int run(const char* path);
+
+    // Errors of the last run, as "line N: message"
+    const std::vector<std::string>& getErrors() const { return errors; }
+
+private:
+    // Record what a line wrote to std::cerr
+    void collect(std::size_t lineNo, const std::string& text);
+
+    Terminal& terminal;
+    std::vector<std::string> errors;
+};
+
+#endif //EX1_SCRIPT_RUNNER_H
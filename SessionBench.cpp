@@ -0,0 +1,182 @@
+#include "SessionBench.h"
+#include "OutputBuffer.h"
+#include "Terminal.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Shape of the shared tree: DIRS folders of FILES files each
+static const int DIRS = 16;
+static const int FILES = 8;
+
+// Length of each shared file and of each session's own file
+static const int FILE_LENGTH = 1024;
+static const int OWN_LENGTH = 128;
+
+// Bytes of output a session buffers before writing them to /dev/null
+static const std::size_t SINK_BLOCK = 64 * 1024;
+
+// Command mix as cumulative percentages: read, readrange, cat, wc, wc -r, chdir + ls, pwd, writestr, touch + remove
+static const int MIX[] = {35, 55, 65, 72, 75, 80, 85, 98, 100};
+
+// xorshift64: cheap per-session pseudo-random numbers, so every run issues the same commands
+static std::uint64_t nextRandom(std::uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Text of n characters made of words and spaces, so wc has something to count
+static std::string filler(int n) {
+    static const char words[] = "lorem ipsum dolor sit amet consectetur adipiscing elit ";
+    std::string s;
+    while (static_cast<int>(s.size()) < n) s += words;
+    s.resize(static_cast<std::size_t>(n));
+    s.back() = '.';
+    return s;
+}
+
+// One session of a run: its own streams and Terminal on the shared tree
+struct BenchSession {
+    OutputBuffer sink;
+    std::ostream out;
+    std::ostringstream err;
+    Terminal terminal;
+    int id;
+
+    BenchSession(int devNull, const std::shared_ptr<FolderTree>& tree, int id)
+            : sink(devNull, SINK_BLOCK), out(&sink), terminal(tree, out, err), id(id) {}
+
+    // Issue count commands of the mix
+    void work(std::size_t count) {
+        std::uint64_t state = 0x9E3779B97F4A7C15ull * static_cast<std::uint64_t>(id + 1);
+        std::string own = "V/bench/s" + std::to_string(id) + ".txt";
+        std::string tmp = "V/bench/s" + std::to_string(id) + "_tmp.txt";
+        char line[128];
+        for (std::size_t i = 0; i < count; ++i) {
+            std::uint64_t r = nextRandom(state);
+            int dir = static_cast<int>((r >> 8) % DIRS), file = static_cast<int>((r >> 16) % FILES);
+            int at = static_cast<int>((r >> 24) % FILE_LENGTH);
+            int pick = 0;
+            while (static_cast<int>(r % 100) >= MIX[pick]) ++pick;
+            switch (pick) {
+                case 0:
+                    std::snprintf(line, sizeof line, "read V/bench/d%d/f%d.txt %d", dir, file, at);
+                    break;
+                case 1:
+                    std::snprintf(line, sizeof line, "readrange V/bench/d%d/f%d.txt %d 64", dir, file, at);
+                    break;
+                case 2:
+                    std::snprintf(line, sizeof line, "cat V/bench/d%d/f%d.txt", dir, file);
+                    break;
+                case 3:
+                    std::snprintf(line, sizeof line, "wc V/bench/d%d/f%d.txt", dir, file);
+                    break;
+                case 4:
+                    std::snprintf(line, sizeof line, "wc -r V/bench/d%d/", dir);
+                    break;
+                case 5:
+                    std::snprintf(line, sizeof line, "chdir V/bench/d%d/", dir);
+                    terminal.executeCommand(line);
+                    std::snprintf(line, sizeof line, "ls V/bench/d%d/", dir);
+                    break;
+                case 6:
+                    std::snprintf(line, sizeof line, "pwd");
+                    break;
+                case 7:
+                    std::snprintf(line, sizeof line, "writestr %s %d session %d wrote", own.c_str(),
+                                  at % (OWN_LENGTH - 32), id);
+                    break;
+                default:
+                    std::snprintf(line, sizeof line, "touch %s", tmp.c_str());
+                    terminal.executeCommand(line);
+                    std::snprintf(line, sizeof line, "remove %s", tmp.c_str());
+                    break;
+            }
+            terminal.executeCommand(line);
+        }
+        out.flush();
+    }
+};
+
+// Build the shared tree, then time one run per session count
+int SessionBench::run(Storage::Mode mode, unsigned maxSessions, std::size_t commands) {
+    int devNull = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devNull < 0) {
+        std::cerr << "ERROR: cannot open /dev/null" << std::endl;
+        return 1;
+    }
+    if (maxSessions == 0) maxSessions = 1;
+    int failures = 0;
+    {
+        OutputBuffer sink(devNull, SINK_BLOCK);
+        std::ostream out(&sink);
+        std::ostringstream err;
+        Terminal setup(mode, out, err);
+        std::string text = filler(FILE_LENGTH);
+        setup.executeCommand("mkdir V/bench/");
+        for (int d = 0; d < DIRS; ++d) {
+            std::string dir = "V/bench/d" + std::to_string(d) + "/";
+            setup.executeCommand("mkdir " + dir);
+            for (int f = 0; f < FILES; ++f) {
+                std::string file = dir + "f" + std::to_string(f) + ".txt";
+                setup.executeCommand("touch " + file);
+                setup.executeCommand("writestr " + file + " 0 " + text);
+            }
+        }
+        std::string own = filler(OWN_LENGTH);
+        for (unsigned s = 0; s < maxSessions; ++s) {
+            std::string file = "V/bench/s" + std::to_string(s) + ".txt";
+            setup.executeCommand("touch " + file);
+            setup.executeCommand("writestr " + file + " 0 " + own);
+        }
+        if (!err.str().empty()) {
+            std::cerr << "ERROR: setup: " << err.str();
+            ::close(devNull);
+            return 1;
+        }
+
+        std::cout << "Hardware threads: " << std::thread::hardware_concurrency()
+                  << ", Commands per session: " << commands << std::endl;
+        std::vector<unsigned> runs;
+        for (unsigned n = 1; n < maxSessions; n *= 2) runs.push_back(n);
+        runs.push_back(maxSessions);
+        double base = 0;
+        for (unsigned n : runs) {
+            std::vector<std::unique_ptr<BenchSession>> sessions;
+            for (unsigned s = 0; s < n; ++s) {
+                sessions.emplace_back(new BenchSession(devNull, setup.getTree(), static_cast<int>(s)));
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (auto& s : sessions) threads.emplace_back(&BenchSession::work, s.get(), commands);
+            for (auto& t : threads) t.join();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double rate = static_cast<double>(commands) * n / seconds;
+            if (n == 1) base = rate;
+            std::cout << "Sessions: " << n << std::fixed
+                      << ", Seconds: " << std::setprecision(3) << seconds
+                      << ", Commands/s: " << std::setprecision(0) << rate
+                      << ", Speedup: " << std::setprecision(2) << rate / base << std::endl;
+            for (auto& s : sessions) {
+                std::string e = s->err.str();
+                if (e.empty()) continue;
+                ++failures;
+                std::cerr << "ERROR: session " << s->id << ": " << e.substr(0, e.find('\n')) << std::endl;
+            }
+        }
+    }
+    ::close(devNull);
+    return failures == 0 ? 0 : 1;
+}
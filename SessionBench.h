@@ -0,0 +1,17 @@
+#ifndef EX1_SESSION_BENCH_H
+#define EX1_SESSION_BENCH_H
+
+#include <cstddef>
+#include "Storage.h"
+
+// SessionBench class: stress benchmark for Terminal sessions sharing one tree.
+// Builds a tree of small files, then runs the same command mix on 1, 2, 4, ... session threads at once
+// and prints the throughput of each run. Most commands only read (read, readrange, cat, wc, ls, pwd);
+// every session also writes a file of its own and now and then adds and removes one.
+class SessionBench {
+public:
+    // Run with up to maxSessions threads, each executing commands lines; returns 0 if no command failed
+    static int run(Storage::Mode mode, unsigned maxSessions, std::size_t commands = 100000);
+};
+
+#endif //EX1_SESSION_BENCH_H
@@ -0,0 +1,210 @@
+#include "Snapshot.h"
+#include "FileException.h"
+#include "FolderWalk.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Start of a snapshot, followed by the folder records, the file records, the names and the contents
+struct SnapshotHeader {
+    char magic[8];               // "VTSNAP2\n"
+    std::uint64_t folders;       // Number of folder records; record 0 is the root
+    std::uint64_t files;         // Number of file records
+    std::uint64_t folderTable;   // Offset of the folder records
+    std::uint64_t fileTable;     // Offset of the file records
+};
+
+static const char MAGIC[8] = {'V', 'T', 'S', 'N', 'A', 'P', '2', '\n'};
+
+// Folders breadth first, each folder's files and subfolders as consecutive records; then the names and contents
+void Snapshot::save(const Folder& root, const std::string& hostPath) {
+    FolderWalk<const Folder> walk(FolderWalk<const Folder>::BreadthFirst);
+    std::vector<FolderRecord> folderRecords;
+    std::vector<FileRecord> fileRecords;
+    std::vector<const FileManager*> fileOrder;
+    std::string names;
+    std::size_t nextFolder = 1;  // record of the first subfolder not given a place yet
+    walk.start(root);
+    while (const Folder* f = walk.next()) {
+        FolderRecord rec{};
+        rec.name = names.size();
+        rec.nameLength = f->foldername.size();
+        names.append(f->foldername);
+        rec.firstFolder = nextFolder;
+        rec.folders = f->subfolders.size();
+        nextFolder += rec.folders;
+        rec.firstFile = fileRecords.size();
+        rec.files = f->files.size();
+        for (const auto& fm : f->files) {
+            std::string_view leaf = Path::leaf(fm.getFileName());
+            FileRecord fr{};
+            fr.name = names.size();
+            fr.nameLength = leaf.size();
+            fr.size = static_cast<std::uint64_t>(fm.getSize());
+            names.append(leaf);
+            fileRecords.push_back(fr);
+            fileOrder.push_back(&fm);
+        }
+        folderRecords.push_back(rec);
+    }
+
+    SnapshotHeader h{};
+    std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+    h.folders = folderRecords.size();
+    h.files = fileRecords.size();
+    h.folderTable = sizeof h;
+    h.fileTable = h.folderTable + folderRecords.size() * sizeof(FolderRecord);
+    std::uint64_t nameBase = h.fileTable + fileRecords.size() * sizeof(FileRecord);
+    std::uint64_t data = nameBase + names.size();
+    for (auto& rec : folderRecords) rec.name += nameBase;
+    for (auto& fr : fileRecords) {
+        fr.name += nameBase;
+        fr.data = data;
+        data += fr.size;
+    }
+
+    std::ofstream out(hostPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw FileException(FileException::ErrorType::NotOpen, "Unable to open file: " + hostPath);
+    }
+    out.write(reinterpret_cast<const char*>(&h), sizeof h);
+    out.write(reinterpret_cast<const char*>(folderRecords.data()),
+              static_cast<std::streamsize>(folderRecords.size() * sizeof(FolderRecord)));
+    out.write(reinterpret_cast<const char*>(fileRecords.data()),
+              static_cast<std::streamsize>(fileRecords.size() * sizeof(FileRecord)));
+    out.write(names.data(), static_cast<std::streamsize>(names.size()));
+    for (const FileManager* fm : fileOrder) {
+        std::string contents = fm->read(0, fm->getSize());
+        out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+    if (!out.flush()) {
+        throw FileException(FileException::ErrorType::WriteError, "Failed to write to file: " + hostPath);
+    }
+}
+
+// List the saved tree from the mapping, build the folders in one pass, then fill the files
+void Snapshot::load(Folder& root, const std::string& hostPath, Session& session) {
+    std::shared_ptr<const Snapshot> snap = open(hostPath);
+    std::vector<std::string> dirs, paths;
+    std::vector<const FileRecord*> records;
+    std::vector<std::pair<std::uint64_t, std::string>> pending{{0, std::string()}};
+    while (!pending.empty()) {
+        const FolderRecord& rec = snap->folder(pending.back().first);
+        std::string prefix = std::move(pending.back().second);
+        pending.pop_back();
+        for (std::uint64_t i = 0; i < rec.files; ++i) {
+            const FileRecord& fr = snap->file(rec.firstFile + i);
+            paths.push_back(prefix + std::string(snap->name(fr.name, fr.nameLength)));
+            records.push_back(&fr);
+        }
+        for (std::uint64_t i = 0; i < rec.folders; ++i) {
+            const FolderRecord& sub = snap->folder(rec.firstFolder + i);
+            dirs.push_back(prefix + std::string(snap->name(sub.name, sub.nameLength)));
+        }
+        for (std::uint64_t i = rec.folders; i > 0; --i) {
+            const FolderRecord& sub = snap->folder(rec.firstFolder + i - 1);
+            pending.emplace_back(rec.firstFolder + i - 1, prefix + std::string(snap->name(sub.name, sub.nameLength)) + '/');
+        }
+    }
+
+    std::vector<FileManager*> added;
+    if (!root.addTree(Path("V"), dirs, paths, added, session)) return;
+    for (std::size_t i = 0; i < added.size(); ++i) {
+        FileManager* fm = added[i];
+        if (!fm) continue;
+        fm->touch(fm->getFileName().c_str());
+        fm->clear();  // also drops what a crashed run left in the backing file
+        fm->write(0, snap->data(*records[i]));
+    }
+}
+
+// Map the whole snapshot read-only; the header and the shape of the tree are checked here, names and
+// contents when they are read
+std::shared_ptr<const Snapshot> Snapshot::open(const std::string& hostPath) {
+    int fd = ::open(hostPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw FileException(FileException::ErrorType::NotOpen, "Unable to open file: " + hostPath);
+    }
+    struct stat st{};
+    void* m = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(SnapshotHeader)) {
+        m = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        throw FileException(FileException::ErrorType::ReadError, "Not a snapshot: " + hostPath);
+    }
+    return std::shared_ptr<const Snapshot>(
+            new Snapshot(hostPath, static_cast<const char*>(m), static_cast<std::size_t>(st.st_size)));
+}
+
+// Check the header and locate the record tables
+Snapshot::Snapshot(std::string hostPath, const char* mapped, std::size_t length)
+        : path(std::move(hostPath)), base(mapped), size(length) {
+    SnapshotHeader h;
+    std::memcpy(&h, base, sizeof h);
+    if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0) {
+        ::munmap(const_cast<char*>(base), size);
+        throw FileException(FileException::ErrorType::ReadError, "Not a snapshot: " + path);
+    }
+    folderCount = h.folders;
+    fileCount = h.files;
+    bool fits = h.folders > 0 && h.folderTable % 8 == 0 && h.fileTable % 8 == 0 &&
+                h.folderTable <= size && (size - h.folderTable) / sizeof(FolderRecord) >= h.folders &&
+                h.fileTable <= size && (size - h.fileTable) / sizeof(FileRecord) >= h.files;
+    if (fits) {
+        folders = reinterpret_cast<const FolderRecord*>(base + h.folderTable);
+        files = reinterpret_cast<const FileRecord*>(base + h.fileTable);
+    }
+    if (!fits || !isTree()) {
+        ::munmap(const_cast<char*>(base), size);
+        throw FileException(FileException::ErrorType::ReadError, "Snapshot is damaged: " + path);
+    }
+}
+
+// Breadth first, the subfolder and file ranges follow each other in record order and every subfolder comes
+// after its parent, so each record but the root has exactly one parent and walking the records ends
+bool Snapshot::isTree() const {
+    std::uint64_t nextFolder = 1, nextFile = 0;
+    for (std::uint64_t i = 0; i < folderCount; ++i) {
+        const FolderRecord& rec = folders[i];
+        if (rec.firstFolder != nextFolder || nextFolder <= i || rec.folders > folderCount - nextFolder) return false;
+        if (rec.firstFile != nextFile || rec.files > fileCount - nextFile) return false;
+        nextFolder += rec.folders;
+        nextFile += rec.files;
+    }
+    return nextFolder == folderCount && nextFile == fileCount;
+}
+
+// The last folder read from it is done with the snapshot
+Snapshot::~Snapshot() {
+    ::munmap(const_cast<char*>(base), size);
+}
+
+const Snapshot::FolderRecord& Snapshot::folder(std::uint64_t i) const {
+    if (i >= folderCount) damaged();
+    return folders[i];
+}
+
+const Snapshot::FileRecord& Snapshot::file(std::uint64_t i) const {
+    if (i >= fileCount) damaged();
+    return files[i];
+}
+
+std::string_view Snapshot::name(std::uint64_t offset, std::uint64_t length) const {
+    if (offset > size || length > size - offset) damaged();
+    return std::string_view(base + offset, length);
+}
+
+std::string_view Snapshot::data(const FileRecord& rec) const {
+    return name(rec.data, rec.size);
+}
+
+void Snapshot::damaged() const {
+    throw FileException(FileException::ErrorType::ReadError, "Snapshot is damaged: " + path);
+}
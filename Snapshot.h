@@ -0,0 +1,68 @@
+#ifndef EX1_SNAPSHOT_H
+#define EX1_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "Folder.h"
+
+// Snapshot class: the folder tree and the contents of every file in one host file, laid out to be mapped and
+// read in place. Folders are stored breadth first, so the subfolders and the files of each folder are
+// consecutive records and any folder can be read without parsing the rest. An opened snapshot stays mapped
+// while folders still read from it. Files shared by ln are saved as separate files.
+class Snapshot {
+public:
+    // One folder: its name and the ranges of its subfolder and file records
+    struct FolderRecord {
+        std::uint64_t name, nameLength;        // Offset and length of the name
+        std::uint64_t firstFolder, folders;    // Subfolder records
+        std::uint64_t firstFile, files;        // File records
+    };
+
+    // One file: its name and contents
+    struct FileRecord {
+        std::uint64_t name, nameLength;        // Offset and length of the name
+        std::uint64_t data, size;              // Offset and length of the contents
+    };
+
+    // Write every folder and file below root to hostPath; folders not read from a snapshot yet are read first.
+    // The caller keeps the tree from changing
+    static void save(const Folder& root, const std::string& hostPath);
+
+    // Add the saved folders and files below root right away; files that already exist are overwritten
+    static void load(Folder& root, const std::string& hostPath, Session& session);
+
+    // Map a snapshot to read folders from it on demand
+    static std::shared_ptr<const Snapshot> open(const std::string& hostPath);
+
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Records and the bytes they point at; a record or byte range out of range throws, the snapshot is damaged
+    const FolderRecord& folder(std::uint64_t i) const;
+    const FileRecord& file(std::uint64_t i) const;
+    std::string_view name(std::uint64_t offset, std::uint64_t length) const;
+    std::string_view data(const FileRecord& rec) const;
+
+private:
+    Snapshot(std::string path, const char* base, std::size_t size);
+
+    // The folder records form a tree laid out breadth first, as save() writes it
+    bool isTree() const;
+
+    // Throw for a damaged snapshot
+    [[noreturn]] void damaged() const;
+
+    std::string path;
+    const char* base;     // Start of the mapping
+    std::size_t size;     // Length of the mapping
+    std::uint64_t folderCount, fileCount;
+    const FolderRecord* folders;
+    const FileRecord* files;
+};
+
+#endif //EX1_SNAPSHOT_H
@@ -0,0 +1,272 @@
+#include "SocketServer.h"
+#include "Terminal.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Most reactors started when the caller leaves the choice to the server
+static const std::size_t MAX_REACTORS = 4;
+
+// Events taken from epoll at once
+static const int MAX_EVENTS = 64;
+
+// Bytes received per recv() call
+static const std::size_t READ_BLOCK = 64 * 1024;
+
+// A connection stops running commands while this much output is waiting to be sent
+static const std::size_t OUT_HIGH = 1 << 20;
+
+// Longest command line accepted; a connection sending more without a newline is closed
+static const std::size_t IN_MAX = 16 << 20;
+
+// Server the signal handlers stop
+static SocketServer* serving = nullptr;
+
+// SIGINT / SIGTERM: let every loop finish, so the tree is cleaned up as on 'exit'
+static void onSignal(int) {
+    if (serving) serving->stop();
+}
+
+// Stream buffer that appends a session's output straight to its connection's unsent output
+class PendingSink : public std::streambuf {
+public:
+    explicit PendingSink(std::string& out) : out(out) {}
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) out.push_back(traits_type::to_char_type(ch));
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        out.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    std::string& out;
+};
+
+// One client: its socket, its buffers and its Terminal session
+struct SocketServer::Connection {
+    int fd;
+    std::string in;      // Received bytes, starting with the first line not run yet
+    std::string out;     // Output not sent yet, from sent on
+    std::size_t sent;
+    PendingSink sink;
+    std::ostream stream;
+    Terminal terminal;   // Writes output and errors to stream, in order
+    bool eof;            // The peer sent everything it will send
+    std::uint32_t events;  // Mask registered with epoll
+
+    Connection(int fd, const std::shared_ptr<FolderTree>& tree)
+            : fd(fd), sent(0), sink(out), stream(&sink), terminal(tree, stream, stream), eof(false), events(0) {}
+
+    ~Connection() { ::close(fd); }
+
+    // A complete line is waiting to be run
+    bool hasLine() const { return in.find('\n') != std::string::npos; }
+};
+
+// Constructor: the stop event exists before run(), so stop() is never lost
+SocketServer::SocketServer(std::shared_ptr<FolderTree> tree, std::size_t reactors)
+        : tree(std::move(tree)), reactors(reactors), listenFd(-1),
+          stopFd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (this->reactors == 0) {
+        this->reactors = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), MAX_REACTORS);
+    }
+}
+
+SocketServer::~SocketServer() {
+    if (stopFd >= 0) ::close(stopFd);
+}
+
+// Make the stop event readable; write() is async-signal-safe
+void SocketServer::stop() {
+    std::uint64_t one = 1;
+    if (stopFd >= 0 && ::write(stopFd, &one, sizeof one) < 0) {
+        // already signalled often enough to overflow the counter
+    }
+}
+
+// Bind and listen, start the reactors and wait for them to finish
+bool SocketServer::run(const std::string& path) {
+    sockaddr_un addr{};
+    if (stopFd < 0 || path.empty() || path.size() >= sizeof addr.sun_path) {
+        std::cerr << "ERROR: cannot listen on " << path << std::endl;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.c_str());  // left by an earlier run
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0
+        || ::listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR: cannot listen on " << path << std::endl;
+        if (listenFd >= 0) ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    std::vector<int> epolls;
+    for (std::size_t i = 0; i < reactors; ++i) {
+        int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) break;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;  // wake one loop per new connection, not all of them
+#endif
+        ev.data.ptr = &listenFd;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+        ev.events = EPOLLIN;  // level-triggered and never read, so every loop sees it
+        ev.data.ptr = &stopFd;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, stopFd, &ev);
+        epolls.push_back(epfd);
+    }
+
+    struct sigaction sa{}, oldInt{}, oldTerm{};
+    sa.sa_handler = onSignal;
+    sigemptyset(&sa.sa_mask);
+    serving = this;
+    ::sigaction(SIGINT, &sa, &oldInt);
+    ::sigaction(SIGTERM, &sa, &oldTerm);
+
+    std::cout << "Listening on " << path << std::endl;
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < epolls.size(); ++i) threads.emplace_back(&SocketServer::loop, this, epolls[i]);
+    if (!epolls.empty()) loop(epolls[0]);
+    for (auto& t : threads) t.join();
+
+    ::sigaction(SIGINT, &oldInt, nullptr);
+    ::sigaction(SIGTERM, &oldTerm, nullptr);
+    serving = nullptr;
+    for (int epfd : epolls) ::close(epfd);
+    ::close(listenFd);
+    listenFd = -1;
+    ::unlink(path.c_str());
+    return !epolls.empty();
+}
+
+// Reactor loop: accept new connections, read commands, run them, send the output
+void SocketServer::loop(int epfd) {
+    std::unordered_map<Connection*, std::unique_ptr<Connection>> connections;
+    epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = ::epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &stopFd) return;  // open connections close with the map
+            if (tag == &listenFd) {
+                int fd;
+                while ((fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Connection* c = new Connection(fd, tree);
+                    connections[c] = std::unique_ptr<Connection>(c);
+                    epoll_event ev{};
+                    ev.events = c->events = EPOLLIN;
+                    ev.data.ptr = c;
+                    ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;  // EAGAIN: another loop took the connection
+            }
+
+            Connection& c = *static_cast<Connection*>(tag);
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                char buf[READ_BLOCK];
+                while (!c.eof && c.in.size() < IN_MAX) {
+                    ssize_t r = ::recv(c.fd, buf, sizeof buf, 0);
+                    if (r > 0) {
+                        c.in.append(buf, static_cast<std::size_t>(r));
+                    } else if (r == 0) {
+                        c.eof = true;
+                        if (!c.in.empty() && c.in.back() != '\n') c.in.push_back('\n');  // run the last line too
+                    } else if (errno != EINTR) {
+                        alive = errno == EAGAIN || errno == EWOULDBLOCK;
+                        break;
+                    }
+                }
+            }
+            // Run and send until the output backs up or no complete line is left
+            while (alive) {
+                execute(c);
+                alive = flush(c);
+                if (!c.out.empty() || !c.terminal.isRunning() || !c.hasLine()) break;
+            }
+            bool done = !c.terminal.isRunning() || (c.eof && !c.hasLine())
+                        || (c.in.size() >= IN_MAX && !c.hasLine());
+            if (!alive || (done && c.out.empty())) {
+                ::epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+                connections.erase(&c);
+                continue;
+            }
+            std::uint32_t want = 0;
+            if (!c.out.empty()) want |= EPOLLOUT;
+            if (!done && !c.eof && c.in.size() < IN_MAX) want |= EPOLLIN;
+            if (want != c.events) {
+                epoll_event ev{};
+                ev.events = c.events = want;
+                ev.data.ptr = &c;
+                ::epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+            }
+        }
+    }
+}
+
+// Run complete lines in order, each response ended by a NUL byte
+void SocketServer::execute(Connection& c) {
+    std::size_t pos = 0;
+    while (c.terminal.isRunning() && c.out.size() - c.sent < OUT_HIGH) {
+        std::size_t nl = c.in.find('\n', pos);
+        if (nl == std::string::npos) break;
+        std::string_view line(c.in.data() + pos, nl - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        c.terminal.executeCommand(line);
+        c.stream.flush();
+        c.out.push_back('\0');
+        pos = nl + 1;
+    }
+    c.in.erase(0, pos);
+}
+
+// Send until done or the socket buffer is full
+bool SocketServer::flush(Connection& c) {
+    while (c.sent < c.out.size()) {
+        ssize_t n = ::send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            c.sent += static_cast<std::size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (c.sent > c.out.size() / 2) {  // keep the buffer from growing with what was already sent
+                c.out.erase(0, c.sent);
+                c.sent = 0;
+            }
+            return true;
+        } else {
+            return false;
+        }
+    }
+    c.out.clear();
+    c.sent = 0;
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef EX1_SOCKET_SERVER_H
+#define EX1_SOCKET_SERVER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "FolderTree.h"
+
+// SocketServer class: serves the command language to many clients over a Unix-domain stream socket.
+// A small pool of reactor threads each runs an epoll loop; the listening socket is shared by all of them
+// and a new connection is accepted by whichever loop wakes up. Every connection is a Terminal session on
+// the shared tree, with its own working directory. Clients may pipeline commands: each complete line is
+// run in order, and its output (errors included) is followed by a NUL byte so responses can be told apart.
+// 'exit' closes the connection; the server runs until SIGINT or SIGTERM.
+class SocketServer {
+public:
+    // Serve the given tree with reactors event loops (0: one per hardware thread, at most 4)
+    explicit SocketServer(std::shared_ptr<FolderTree> tree, std::size_t reactors = 0);
+    ~SocketServer();
+
+    SocketServer(const SocketServer&) = delete;
+    SocketServer& operator=(const SocketServer&) = delete;
+
+    // Listen at path (replacing a stale socket file) and serve until stop(); returns false if it cannot listen
+    bool run(const std::string& path);
+
+    // Make every loop finish; safe to call from a signal handler or another thread
+    void stop();
+
+private:
+    struct Connection;
+
+    // One reactor: wait for events on its epoll instance and serve its connections
+    void loop(int epfd);
+
+    // Run the complete lines received so far, while the connection's unsent output stays small
+    static void execute(Connection& c);
+
+    // Send pending output until the socket would block; returns false if the peer is gone
+    static bool flush(Connection& c);
+
+    std::shared_ptr<FolderTree> tree;
+    std::size_t reactors;
+    int listenFd;  // Listening socket, watched by every loop
+    int stopFd;    // eventfd that becomes readable when the server stops
+};
+
+#endif //EX1_SOCKET_SERVER_H
@@ -0,0 +1,220 @@
+#include "Storage.h"
+#include "StreamStorage.h"
+#include "MmapStorage.h"
+#include "MemoryStorage.h"
+#include "ImageStorage.h"
+#include "CowStorage.h"
+#include "HandlePool.h"
+#include "PageCache.h"
+#include "FileException.h"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes requested per copy_file_range() call
+static const std::size_t TRANSFER_CHUNK = 1 << 30;
+
+// Block size of the read/write fallback
+static const std::size_t TRANSFER_BLOCK = 64 * 1024;
+
+// Backend in use, the stream backend unless select() chose another
+static std::atomic<Storage*> selected{nullptr};
+
+// Guards the fields below and switching backends
+static std::mutex selectLock;
+static Storage::Mode selectedMode = Storage::Stream;
+static std::size_t users = 0;  // Trees that selected the backend and have not released it
+
+// Returns the backend selected for this process
+Storage& Storage::get() {
+    Storage* s = selected.load(std::memory_order_acquire);
+    if (s) return *s;
+    {
+        std::lock_guard<std::mutex> g(selectLock);
+        if (!selected.load(std::memory_order_relaxed)) install(Stream);
+    }
+    return *selected.load(std::memory_order_acquire);
+}
+
+// Select the backend for a new tree; switching flushes and closes the previous one first,
+// and would pull the files of a live tree out from under it (and drop its copy-on-write layers)
+void Storage::select(Mode mode) {
+    std::lock_guard<std::mutex> g(selectLock);
+    if (!selected.load(std::memory_order_relaxed) || selectedMode != mode) {
+        if (users > 0) {
+            throw FileException(FileException::ErrorType::NotOpen,
+                                "Storage backend is in use by another tree");
+        }
+        install(mode);
+    }
+    ++users;
+}
+
+// A tree is done with the backend
+void Storage::release() {
+    std::lock_guard<std::mutex> g(selectLock);
+    if (users > 0) --users;
+}
+
+// Put the backend for mode behind the copy-on-write front; selectLock is held
+void Storage::install(Mode mode) {
+    // Construct the shared pools first so they outlive the backends at exit
+    HandlePool::instance();
+    PageCache::instance();
+    StreamStorage& stream = StreamStorage::instance();
+    static MmapStorage mmap;
+    static MemoryStorage memory;
+    static ImageStorage image;
+    static CowStorage cow;  // constructed last, so its layer files are deleted while the backends still exist
+    if (Storage* previous = selected.load(std::memory_order_relaxed)) previous->closeAll();
+    switch (mode) {
+        case Mmap:
+            cow.attach(mmap);
+            break;
+        case Memory:
+            cow.attach(memory);
+            break;
+        case Image:
+            cow.attach(image);
+            break;
+        default:
+            cow.attach(stream);
+            break;
+    }
+    selectedMode = mode;
+    selected.store(&cow, std::memory_order_release);
+}
+
+// Backends without a zero-copy path leave cat to scan()
+bool Storage::sendTo(const std::string&, int, std::size_t& sent) {
+    sent = 0;
+    return false;
+}
+
+// Backends that keep the bytes to themselves never see outside changes
+std::uint64_t Storage::stamp(const std::string&) {
+    return 0;
+}
+
+// Mix the fields stat() reports for every change to the contents
+std::uint64_t Storage::hostStamp(const std::string& path) {
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0) return 0;
+    std::uint64_t h = 1469598103934665603ull;  // FNV-1a over the fields
+    for (std::uint64_t v : {static_cast<std::uint64_t>(st.st_ino), static_cast<std::uint64_t>(st.st_size),
+                            static_cast<std::uint64_t>(st.st_mtim.tv_sec),
+                            static_cast<std::uint64_t>(st.st_mtim.tv_nsec)}) {
+        h = (h ^ v) * 1099511628211ull;
+    }
+    return h | 1;  // never 0
+}
+
+// Backends on filesystems without reflinks cannot clone
+bool Storage::clone(const std::string&, const std::string&) {
+    return false;
+}
+
+// Default import: read the host file block by block and write it through the backend
+std::size_t Storage::importFile(const std::string& hostPath, const std::string& path) {
+    int in = ::open(hostPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + hostPath);
+    }
+    std::size_t off = 0;
+    try {
+        remove(path);
+        create(path);
+        char buf[TRANSFER_BLOCK];
+        ssize_t n;
+        while ((n = ::pread(in, buf, sizeof buf, static_cast<off_t>(off))) > 0) {
+            write(path, off, buf, static_cast<std::size_t>(n));
+            off += static_cast<std::size_t>(n);
+        }
+        if (n < 0) {
+            throw FileException(FileException::ErrorType::ReadError,
+                                "Failed to read from file: " + hostPath);
+        }
+    } catch (...) {
+        ::close(in);
+        throw;
+    }
+    ::close(in);
+    return off;
+}
+
+// Overwrite a backing file with a host file without going through the backend
+std::size_t Storage::copyHostFile(const std::string& hostPath, const std::string& path) {
+    int in = ::open(hostPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + hostPath);
+    }
+    int out = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        throw FileException(FileException::ErrorType::NotOpen,
+                            "Unable to open file: " + path);
+    }
+    std::size_t n = 0;
+    try {
+        n = transfer(in, out, path);
+    } catch (...) {
+        ::close(in);
+        ::close(out);
+        throw;
+    }
+    ::close(in);
+    ::close(out);
+    return n;
+}
+
+// Truncate outFd, then copy_file_range() until end of file; falls back to pread/pwrite where unsupported
+std::size_t Storage::transfer(int inFd, int outFd, const std::string& path) {
+    if (::ftruncate(outFd, 0) != 0) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to truncate target file: " + path);
+    }
+    off_t inOff = 0, outOff = 0;
+#ifdef __linux__
+    for (;;) {
+        ssize_t n = ::copy_file_range(inFd, &inOff, outFd, &outOff, TRANSFER_CHUNK, 0);
+        if (n > 0) continue;
+        if (n == 0) return static_cast<std::size_t>(outOff);
+        if (errno == EINTR) continue;
+        if (outOff == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) break;
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to copy into file: " + path);
+    }
+#endif
+    char buf[TRANSFER_BLOCK];
+    ssize_t n;
+    while ((n = ::pread(inFd, buf, sizeof buf, inOff)) > 0) {
+        if (::pwrite(outFd, buf, static_cast<std::size_t>(n), outOff) != n) {
+            throw FileException(FileException::ErrorType::CopyError,
+                                "Failed to copy into file: " + path);
+        }
+        inOff += n;
+        outOff += n;
+    }
+    if (n < 0) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to read source of file: " + path);
+    }
+    return static_cast<std::size_t>(outOff);
+}
+
+// Sleep in poll() until a non-blocking outFd can take bytes again, instead of retrying the write in a busy loop
+bool Storage::retrySend(int outFd) {
+    if (errno == EINTR) return true;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+    pollfd p{outFd, POLLOUT, 0};
+    for (;;) {
+        int n = ::poll(&p, 1, -1);
+        if (n > 0) return true;  // writable, or an error the retried write reports
+        if (n < 0 && errno != EINTR) return false;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef EX1_STORAGE_H
+#define EX1_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Storage class: backend that holds the bytes of virtual files, addressed by backing path.
+// One backend serves the whole process; each FolderTree selects it when it is constructed, and trees
+// that live at the same time must agree on it.
+// Every method may be called from several threads at once; callers keep one file from being
+// written while it is read, copied or removed (the Terminal's per-file locks do that).
+class Storage {
+public:
+    enum Mode {
+        Stream,  // Pooled descriptors with the write-back page cache (default)
+        Mmap,    // Backing files mapped into memory and grown in large chunks
+        Memory,  // Contents kept in process memory only, nothing is written to disk
+        Image    // Every file packed into one mapped image file
+    };
+
+    // Callback receiving consecutive pieces of a file's contents
+    typedef std::function<void(const char*, std::size_t)> ChunkFn;
+
+    // Returns the backend selected for this process, behind the copy-on-write front (CowStorage)
+    static Storage& get();
+
+    // Select the backend for a new tree, which uses it until release(). Selecting the backend already in use
+    // changes nothing; another one replaces it only when no tree uses it any more, otherwise this throws
+    static void select(Mode mode);
+
+    // A tree is done with the backend
+    static void release();
+
+    virtual ~Storage() = default;
+
+    // Create the backing file if it does not exist yet
+    virtual void create(const std::string& path) = 0;
+
+    // Delete the backing file; returns false if it did not exist
+    virtual bool remove(const std::string& path) = 0;
+
+    // Copy up to len bytes at offset into buf; returns the number of bytes read
+    virtual std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) = 0;
+
+    // Write len bytes from buf at offset
+    virtual void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) = 0;
+
+    // Replace the contents of target with the contents of source
+    virtual void copy(const std::string& source, const std::string& target) = 0;
+
+    // Replace the contents of path with the host file at hostPath; returns the new length.
+    // The path must not share blocks with a copy
+    virtual std::size_t importFile(const std::string& hostPath, const std::string& path);
+
+    // Make target a copy of source that shares its blocks on disk (FICLONE), in O(1).
+    // Returns false if the filesystem cannot clone, leaving the copy to the caller
+    virtual bool clone(const std::string& source, const std::string& target);
+
+    // Move a backing file to a new path, replacing any file there
+    virtual void rename(const std::string& from, const std::string& to) = 0;
+
+    // Logical length of the file in bytes
+    virtual std::size_t length(const std::string& path) = 0;
+
+    // Pass the whole file to fn in order, in as few pieces as the backend allows
+    // (large files arrive as one piece, so callers can split the work across threads).
+    // Backends do not hold their lock while fn runs, so scans of different files overlap
+    virtual void scan(const std::string& path, const ChunkFn& fn) = 0;
+
+    // Write the whole file to outFd without staging it in a user-space buffer.
+    // Sets sent to the number of bytes written; returns false if the backend cannot do it
+    virtual bool sendTo(const std::string& path, int outFd, std::size_t& sent);
+
+    // Value that changes whenever the file changes, whoever changes it; callers keep what they know about
+    // the contents while it stays the same. Backends no other process can write to return 0
+    virtual std::uint64_t stamp(const std::string& path);
+
+    // Push pending writes of every file to the backing files
+    virtual void flushAll() = 0;
+
+    // Push pending writes and make them durable
+    virtual void syncAll() = 0;
+
+    // Flush and release every open resource (descriptors, mappings)
+    virtual void closeAll() = 0;
+
+protected:
+    // Copy everything from inFd to outFd starting at offset 0, in the kernel (copy_file_range) when it can;
+    // returns the number of bytes copied. Descriptor offsets are left untouched
+    static std::size_t transfer(int inFd, int outFd, const std::string& path);
+
+    // Overwrite the backing file at path with the host file through private descriptors; returns the new length.
+    // The caller first drops whatever the backend caches for path. Nothing is synced, like any other write
+    static std::size_t copyHostFile(const std::string& hostPath, const std::string& path);
+
+    // Stamp of a file on the host from its inode, size and modification time; 0 if it does not exist
+    static std::uint64_t hostStamp(const std::string& path);
+
+    // After a write or sendfile to outFd failed with errno: true if it is worth retrying, because it was
+    // interrupted or because outFd is a full non-blocking pipe or socket, which this waits to drain
+    static bool retrySend(int outFd);
+
+    std::mutex stateLock;  // Guards the backend's caches, descriptors and mappings
+
+private:
+    // Put the backend for mode behind the copy-on-write front, closing the previous one
+    static void install(Mode mode);
+};
+
+#endif //EX1_STORAGE_H
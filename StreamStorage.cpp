@@ -0,0 +1,242 @@
+#include "StreamStorage.h"
+#include "HandlePool.h"
+#include "PageCache.h"
+#include "FileException.h"
+#include <cerrno>
+#include <cstdio>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Block size for whole-file transfers (copy, scan)
+static const std::size_t COPY_BLOCK = 64 * 1024;
+
+// Files at least this large are scanned through a read-only mapping instead of block reads
+static const std::size_t SCAN_MAP_MIN = 1 << 20;
+
+// Bytes handed to one sendfile() call
+static const std::size_t SEND_CHUNK = 1 << 30;
+
+// Returns the process-wide stream backend
+StreamStorage& StreamStorage::instance() {
+    static StreamStorage stream;
+    return stream;
+}
+
+// Copy the cache's counters while no call can change them
+StreamStorage::CacheStats StreamStorage::cacheStats() {
+    std::lock_guard<std::mutex> g(stateLock);
+    const PageCache& cache = PageCache::instance();
+    return { cache.size(), cache.getCapacity(), cache.dirtyPages(), cache.getStats() };
+}
+
+// Create the backing file if it does not exist yet
+void StreamStorage::create(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    HandlePool::instance().open(path, true);
+}
+
+// Drop cached pages and the pooled descriptor, then delete the backing file
+bool StreamStorage::remove(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().invalidate(path);
+    HandlePool::instance().close(path);
+    if (std::remove(path.c_str()) != 0) {
+        if (errno == ENOENT) return false;  // the file never existed on disk
+        throw FileException(FileException::ErrorType::DeleteError,
+                            "Failed to delete file: " + path);
+    }
+    return true;
+}
+
+// Read through the page cache
+std::size_t StreamStorage::read(const std::string& path, std::size_t offset, char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    return PageCache::instance().read(path, offset, buf, len);
+}
+
+// Write through the page cache
+void StreamStorage::write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().write(path, offset, buf, len);
+}
+
+// Copy between the pooled descriptors of both files, inside the kernel where possible; the bytes move
+// without holding the lock
+void StreamStorage::copy(const std::string& source, const std::string& target) {
+    std::unique_lock<std::mutex> g(stateLock);
+    PageCache::instance().flush(source);
+    PageCache::instance().invalidate(target);
+    auto src = HandlePool::instance().open(source);
+    auto dst = HandlePool::instance().open(target, true);  // both pins are dropped under the lock
+    g.unlock();
+    try {
+        transfer(src.fd(), dst.fd(), target);
+    } catch (...) {
+        g.lock();
+        throw;
+    }
+    g.lock();
+    dst.written();
+}
+
+// Drop the target's pages and pooled descriptor under the lock, then copy the host file without holding it
+std::size_t StreamStorage::importFile(const std::string& hostPath, const std::string& path) {
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        PageCache::instance().invalidate(path);
+        HandlePool::instance().close(path);
+    }
+    return copyHostFile(hostPath, path);
+}
+
+// Share the source's extents with the target through a reflink
+bool StreamStorage::clone(const std::string& source, const std::string& target) {
+#ifdef FICLONE
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flush(source);
+    PageCache::instance().invalidate(target);
+    auto src = HandlePool::instance().open(source);
+    auto dst = HandlePool::instance().open(target, true);
+    if (::ioctl(dst.fd(), FICLONE, src.fd()) != 0) return false;
+    dst.written();
+    return true;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+// Write back the cached pages and close both descriptors, then rename on disk
+void StreamStorage::rename(const std::string& from, const std::string& to) {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flush(from);
+    PageCache::instance().invalidate(from);
+    PageCache::instance().invalidate(to);
+    HandlePool::instance().close(from);
+    HandlePool::instance().close(to);
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        throw FileException(FileException::ErrorType::CopyError,
+                            "Failed to rename file: " + from);
+    }
+}
+
+// Size on disk once the cached pages are written back
+std::size_t StreamStorage::length(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flush(path);
+    auto h = HandlePool::instance().open(path);
+    struct stat st{};
+    if (::fstat(h.fd(), &st) != 0) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to stat file: " + path);
+    }
+    return static_cast<std::size_t>(st.st_size);
+}
+
+// Write back the cached pages first, so the file on disk shows every change the process made
+std::uint64_t StreamStorage::stamp(const std::string& path) {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flush(path);
+    return hostStamp(path);
+}
+
+// Pass a whole open file to fn; large files are mapped and passed as one piece
+static void scanDescriptor(int fd, const std::string& path, const Storage::ChunkFn& fn) {
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= SCAN_MAP_MIN) {
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            ::madvise(base, size, MADV_SEQUENTIAL);
+            try {
+                fn(static_cast<const char*>(base), size);
+            } catch (...) {
+                ::munmap(base, size);
+                throw;
+            }
+            ::munmap(base, size);
+            return;
+        }
+    }
+    char buf[COPY_BLOCK];
+    off_t off = 0;
+    ssize_t n;
+    while ((n = ::pread(fd, buf, sizeof buf, off)) > 0) {
+        fn(buf, static_cast<std::size_t>(n));
+        off += n;
+    }
+    if (n < 0) {
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to read from file: " + path);
+    }
+}
+
+// Flush and pin the descriptor under the lock, then read it without holding the lock
+void StreamStorage::scan(const std::string& path, const ChunkFn& fn) {
+    std::unique_lock<std::mutex> g(stateLock);
+    PageCache::instance().flush(path);
+    auto h = HandlePool::instance().open(path);  // destroyed before g, so the pin is dropped under the lock
+    g.unlock();
+    try {
+        scanDescriptor(h.fd(), path, fn);
+    } catch (...) {
+        g.lock();
+        throw;
+    }
+    g.lock();
+}
+
+// sendfile() from the pooled descriptor after writing back the file's cached pages; the lock is only held
+// to flush and pin the descriptor
+bool StreamStorage::sendTo(const std::string& path, int outFd, std::size_t& sent) {
+    sent = 0;
+    std::unique_lock<std::mutex> g(stateLock);
+    PageCache::instance().flush(path);
+    auto h = HandlePool::instance().open(path);  // destroyed before g, so the pin is dropped under the lock
+    g.unlock();
+    off_t off = 0;
+    bool sendable = true;
+    for (;;) {
+        ssize_t n = ::sendfile(outFd, h.fd(), &off, SEND_CHUNK);
+        if (n > 0) continue;
+        if (n == 0) break;
+        if (retrySend(outFd)) continue;
+        if (off == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            sendable = false;  // let the caller copy instead
+            break;
+        }
+        g.lock();
+        throw FileException(FileException::ErrorType::ReadError,
+                            "Failed to send file: " + path);
+    }
+    g.lock();
+    sent = static_cast<std::size_t>(off);
+    return sendable;
+}
+
+// Write back every dirty page
+void StreamStorage::flushAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flushAll();
+}
+
+// Write back every dirty page and fdatasync the written descriptors
+void StreamStorage::syncAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flushAll();
+    HandlePool::instance().syncAll();
+}
+
+// Write back every dirty page and close the pooled descriptors
+void StreamStorage::closeAll() {
+    std::lock_guard<std::mutex> g(stateLock);
+    PageCache::instance().flushAll();
+    HandlePool::instance().closeAll();
+}
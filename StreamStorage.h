@@ -0,0 +1,42 @@
+#ifndef EX1_STREAM_STORAGE_H
+#define EX1_STREAM_STORAGE_H
+
+#include "PageCache.h"
+#include "Storage.h"
+
+// StreamStorage class: positioned I/O on pooled descriptors, through the write-back page cache.
+// The cache and the pool are shared by every file, so each call holds the backend's lock while it uses them
+class StreamStorage : public Storage {
+public:
+    // Page cache occupancy and counters at one moment
+    struct CacheStats {
+        std::size_t pages;          // Cached pages
+        std::size_t capacity;       // Maximum number of cached pages
+        std::size_t dirty;          // Cached pages not written back yet
+        PageCache::Stats counters;
+    };
+
+    // Returns the process-wide stream backend
+    static StreamStorage& instance();
+
+    // Read the page cache's occupancy and counters under the backend's lock
+    CacheStats cacheStats();
+
+    void create(const std::string& path) override;
+    bool remove(const std::string& path) override;
+    std::size_t read(const std::string& path, std::size_t offset, char* buf, std::size_t len) override;
+    void write(const std::string& path, std::size_t offset, const char* buf, std::size_t len) override;
+    void copy(const std::string& source, const std::string& target) override;
+    bool clone(const std::string& source, const std::string& target) override;
+    std::size_t importFile(const std::string& hostPath, const std::string& path) override;
+    void rename(const std::string& from, const std::string& to) override;
+    std::size_t length(const std::string& path) override;
+    void scan(const std::string& path, const ChunkFn& fn) override;
+    bool sendTo(const std::string& path, int outFd, std::size_t& sent) override;
+    std::uint64_t stamp(const std::string& path) override;
+    void flushAll() override;
+    void syncAll() override;
+    void closeAll() override;
+};
+
+#endif //EX1_STREAM_STORAGE_H
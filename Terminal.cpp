@@ -1,202 +1,396 @@
 #include "Terminal.h"
-#include <sstream>
+#include "Reaper.h"
+#include "Snapshot.h"
+#include "StreamStorage.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <algorithm>
-#include <cstdlib>
-
-std::string Terminal::pathpys = "V#";
-std::string Terminal::currpath;
-Terminal::Terminal() {
-    // Initialize the root folder with the name "V"
-    root = new Folder("V");
-
-    // Initialize the command map with function mappings
-    // Each command is mapped to a corresponding handler method
-    commandMap["touch"] = [this](const std::vector<std::string>& tokens) { handleTouch(tokens); };
-    commandMap["remove"] = [this](const std::vector<std::string>& tokens) { handleRemove(tokens); };
-    commandMap["read"] = [this](const std::vector<std::string>& tokens) { handleRead(tokens); };
-    commandMap["write"] = [this](const std::vector<std::string>& tokens) { handleWrite(tokens); };
-    commandMap["cat"] = [this](const std::vector<std::string>& tokens) { handleCat(tokens); };
-    commandMap["wc"] = [this](const std::vector<std::string>& tokens) { handleWc(tokens); };
-    commandMap["copy"] = [this](const std::vector<std::string>& tokens) { handleCopy(tokens); };
-    commandMap["move"] = [this](const std::vector<std::string>& tokens) { handleMove(tokens); };
-    commandMap["ln"] = [this](const std::vector<std::string>& tokens) { handleLn(tokens); };
-    commandMap["mkdir"] = [this](const std::vector<std::string>& tokens) { handleMkdir(tokens); };
-    commandMap["chdir"] = [this](const std::vector<std::string>& tokens) { handleChdir(tokens); };
-    commandMap["rmdir"] = [this](const std::vector<std::string>& tokens) { handleRmdir(tokens); };
-    commandMap["ls"] = [this](const std::vector<std::string>& tokens) { handleLs(tokens); };
-    commandMap["lproot"] = [this](const std::vector<std::string>& tokens) { handleLproot(); };
-    commandMap["pwd"] = [](const std::vector<std::string>& tokens) { handlePwd(); };
-    commandMap["exit"] = [this](const std::vector<std::string>& tokens) { handleExit(); };
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <sys/stat.h>
+
+// Locks taken by the handlers: shared to look up or read, exclusive to change
+typedef std::shared_lock<std::shared_mutex> ReadLock;
+typedef std::unique_lock<std::shared_mutex> WriteLock;
+
+// The tree selects where file contents live before any file is created
+Terminal::Terminal(Storage::Mode mode, std::ostream& out, std::ostream& err)
+        : Terminal(std::make_shared<FolderTree>(mode), out, err) {}
+
+// Join the tree at its root
+Terminal::Terminal(std::shared_ptr<FolderTree> shared, std::ostream& out, std::ostream& err)
+        : tree(std::move(shared)), root(&tree->getRoot()), session{root, out, err},
+          pathpys("V#"), running(true), id(tree->newSession()), logged(0), recovering(false) {
+    WriteLock lock(tree->structure());
+    root->attachSession(session);
 }
 
+// The last session to leave writes back pending data and cleans up the tree
 Terminal::~Terminal() {
-    // Clean up the root folder when the terminal object is destroyed
-    delete root;
+    WriteLock lock(tree->structure());
+    root->detachSession(session);
 }
 
-// Tokenize the input line into individual command tokens
-std::vector<std::string> Terminal::tokenize(const std::string& line) {
-    std::istringstream stream(line);
-    std::string token;
-    std::vector<std::string> tokens;
-    while (stream >> token) {
-        tokens.push_back(token);
+// Tokenize the input line into views of its whitespace-separated tokens
+void Terminal::tokenize(std::string_view line, Tokens& out) {
+    out.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+        size_t start = i;
+        while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+        if (i > start) out.push_back(line.substr(start, i - start));
     }
-    return tokens;
 }
 
-// Convert a user path to an internal representation by replacing '/' with '#'
-std::string Terminal::toInternalPath(const std::string& path) {
-    std::string internal = path;
-    std::replace(internal.begin(), internal.end(), '/', '#');
-    return internal;
+// The text from tokens[first] to the end of the last token, original spacing included
+std::string_view Terminal::restOf(const Tokens& tokens, size_t first) {
+    const char* begin = tokens[first].data();
+    const char* end = tokens.back().data() + tokens.back().size();
+    return std::string_view(begin, static_cast<size_t>(end - begin));
 }
 
-// Execute the command by first tokenizing the input line and then calling the corresponding handler
-void Terminal::executeCommand(const std::string& line) {
-    auto tokens = tokenize(line);
-    if (tokens.empty()) return;
+// Parse a decimal integer token, throwing like std::stoi on bad input
+int Terminal::toInt(std::string_view token) {
+    int value = 0;
+    auto res = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (res.ec == std::errc::result_out_of_range) throw std::out_of_range("stoi");
+    if (res.ec != std::errc() || res.ptr != token.data() + token.size()) throw std::invalid_argument("stoi");
+    return value;
+}
 
-    const std::string& cmd = tokens[0];
+// Execute the command by first tokenizing the input line and then calling the corresponding handler.
+// A command that was logged is acknowledged only once the journal policy says it is safe
+void Terminal::executeCommand(std::string_view input) {
+    tokenize(input, tokens);
+    if (tokens.empty()) return;
 
+    line = input;
     try {
-        // Look for the command in the map and call the corresponding handler if found
-        if (commandMap.find(cmd) != commandMap.end()) {
-            commandMap[cmd](tokens);
-        } else {
-            std::cerr << "Unknown command or wrong number of arguments." << std::endl;
-        }
+        dispatch();
     } catch (const std::exception& e) {
-        std::cerr << "ERROR: " << e.what() << std::endl;
+        session.err << "ERROR: " << e.what() << std::endl;
+    }
+    if (logged) {
+        std::uint64_t seq = logged;
+        logged = 0;
+        try {
+            tree->getJournal()->commit(seq);
+        } catch (const std::exception& e) {
+            session.err << "ERROR: " << e.what() << std::endl;
+        }
     }
 }
 
+// Dispatch on the hash of the name; the switch rejects colliding names at compile time
+void Terminal::dispatch() {
+    std::string_view cmd = tokens[0];
+    switch (commandHash(cmd)) {
+        case commandHash("touch"): if (cmd == "touch") return handleTouch(tokens); break;
+        case commandHash("remove"): if (cmd == "remove") return handleRemove(tokens); break;
+        case commandHash("read"): if (cmd == "read") return handleRead(tokens); break;
+        case commandHash("write"): if (cmd == "write") return handleWrite(tokens); break;
+        case commandHash("readrange"): if (cmd == "readrange") return handleReadRange(tokens); break;
+        case commandHash("writestr"): if (cmd == "writestr") return handleWriteStr(tokens); break;
+        case commandHash("append"): if (cmd == "append") return handleAppend(tokens); break;
+        case commandHash("cat"): if (cmd == "cat") return handleCat(tokens); break;
+        case commandHash("wc"): if (cmd == "wc") return handleWc(tokens); break;
+        case commandHash("copy"): if (cmd == "copy") return handleCopy(tokens); break;
+        case commandHash("move"): if (cmd == "move") return handleMove(tokens); break;
+        case commandHash("ln"): if (cmd == "ln") return handleLn(tokens); break;
+        case commandHash("import"): if (cmd == "import") return handleImport(tokens); break;
+        case commandHash("mkdir"): if (cmd == "mkdir") return handleMkdir(tokens); break;
+        case commandHash("chdir"): if (cmd == "chdir") return handleChdir(tokens); break;
+        case commandHash("rmdir"): if (cmd == "rmdir") return handleRmdir(tokens); break;
+        case commandHash("save"): if (cmd == "save") return handleSave(tokens); break;
+        case commandHash("load"): if (cmd == "load") return handleLoad(tokens); break;
+        case commandHash("ls"): if (cmd == "ls") return handleLs(tokens); break;
+        case commandHash("lproot"): if (cmd == "lproot") return handleLproot(tokens); break;
+        case commandHash("pwd"): if (cmd == "pwd") return handlePwd(); break;
+        case commandHash("sync"): if (cmd == "sync") return handleSync(); break;
+        case commandHash("cachestat"): if (cmd == "cachestat") return handleCacheStat(); break;
+        case commandHash("reapstat"): if (cmd == "reapstat") return handleReapStat(); break;
+        case commandHash("exit"): if (cmd == "exit") return handleExit(); break;
+        default: break;
+    }
+    session.err << "Unknown command or wrong number of arguments." << std::endl;
+}
+
+// Append the current command to the tree's journal, if it keeps one
+void Terminal::log() {
+    if (Journal* journal = tree->getJournal()) logged = journal->append(id, line);
+}
+
+// Replay runs every logged command again on a fresh tree. Output is dropped; commands that failed the first
+// time fail the same way. Each restart marker ends the sessions of the run before it
+std::size_t Terminal::replay(const std::shared_ptr<FolderTree>& tree, Journal& journal) {
+    std::ostringstream sink;
+    std::unordered_map<std::uint32_t, std::unique_ptr<Terminal>> sessions;
+    return journal.replay([&](std::uint32_t session, std::string_view line) {
+        if (session == Journal::RESTART) {
+            sessions.clear();
+            return;
+        }
+        std::unique_ptr<Terminal>& t = sessions[session];
+        if (!t) {
+            t.reset(new Terminal(tree, sink, sink));
+            t->recovering = true;
+        }
+        t->executeCommand(line);
+        sink.str(std::string());
+    });
+}
+
 // Handler for the 'touch' command: Creates a file in the root folder
-void Terminal::handleTouch(const std::vector<std::string>& tokens) {
+void Terminal::handleTouch(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        const std::string& userPath = tokens[1];
-        std::string internal = toInternalPath(userPath);
-        FileManager fm(internal.c_str());
-        fm.touch(internal.c_str());
-        root->addFile(fm);
+        std::string_view userPath = tokens[1];
+        Path path(userPath);
+        WriteLock lock(tree->structure());
+        log();
+        if (recovering && !root->getFile(path)) {
+            Storage::get().remove(path.internal());  // left by the crashed run, possibly longer than logged
+        }
+        FileManager fm(path.internal().c_str());
+        fm.touch(path.internal().c_str());
+        root->addFile(path, std::move(fm), session);
     }
 }
 
 // Handler for the 'remove' command: Removes a file from the root folder
-void Terminal::handleRemove(const std::vector<std::string>& tokens) {
+void Terminal::handleRemove(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        const std::string& userPath = tokens[1];
-        std::string internal = toInternalPath(userPath);
-        root->removeFile(internal);
+        std::string_view userPath = tokens[1];
+        Path path(userPath);
+        WriteLock lock(tree->structure());
+        log();
+        root->removeFile(path, session);
     }
 }
 
 // Handler for the 'read' command: Reads a file at the given path and outputs its content at the specified index
-void Terminal::handleRead(const std::vector<std::string>& tokens) {
+void Terminal::handleRead(const Tokens& tokens) {
     if (tokens.size() == 3) {
-        const std::string& userPath = tokens[1];
-        int index = std::stoi(tokens[2]);
-        std::string internal = toInternalPath(userPath);
-        FileManager* file = root->getFile(internal);
+        std::string_view userPath = tokens[1];
+        int index = toInt(tokens[2]);
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        FileManager* file = root->getFile(path);
         if (!file) {
-            std::cerr << "ERROR: File not found in root folder." << std::endl;
+            session.err << "ERROR: File not found in root folder." << std::endl;
         } else {
-            std::cout << (*file)[index] << std::endl;
+            ReadLock fileLock(tree->fileLock(file));
+            if (!file->isShared() && !file->isShareable()) {
+                session.out << std::as_const(*file)[index] << std::endl;  // nothing changes, so nothing to log
+            } else {
+                fileLock.unlock();
+                WriteLock writeLock(tree->fileLock(file));  // the proxy detaches a value shared by ln
+                log();  // and marks it unshareable, which changes what later writes and ln reach
+                session.out << (*file)[index] << std::endl;
+            }
         }
     }
 }
 
 // Handler for the 'write' command: Writes a value to the file at the specified index
-void Terminal::handleWrite(const std::vector<std::string>& tokens) {
+void Terminal::handleWrite(const Tokens& tokens) {
     if (tokens.size() == 4) {
-        const std::string& userPath = tokens[1];
-        int index = std::stoi(tokens[2]);
-        const std::string& strValue = tokens[3];
+        std::string_view userPath = tokens[1];
+        int index = toInt(tokens[2]);
+        std::string_view strValue = tokens[3];
 
         if (strValue.size() != 1) {
-            std::cerr << "ERROR: Value must be exactly one character." << std::endl;
+            session.err << "ERROR: Value must be exactly one character." << std::endl;
         } else {
             char value = strValue[0];
-            std::string internal = toInternalPath(userPath);
-            FileManager* file = root->getFile(internal);
+            Path path(userPath);
+            ReadLock lock(tree->structure());
+            FileManager* file = root->getFile(path);
             if (!file) {
-                std::cerr << "ERROR: File not found in root folder." << std::endl;
+                session.err << "ERROR: File not found in root folder." << std::endl;
             } else {
+                WriteLock fileLock(tree->fileLock(file));
+                log();
                 (*file)[index] = value;
             }
         }
     }
 }
 
+// Handler for the 'readrange' command: Outputs length characters starting at the specified index
+void Terminal::handleReadRange(const Tokens& tokens) {
+    if (tokens.size() == 4) {
+        std::string_view userPath = tokens[1];
+        int index = toInt(tokens[2]);
+        int length = toInt(tokens[3]);
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        const FileManager* file = root->getFile(path);
+        if (!file) {
+            session.err << "ERROR: File not found in root folder." << std::endl;
+        } else {
+            ReadLock fileLock(tree->fileLock(file));
+            session.out << file->read(index, length) << std::endl;
+        }
+    }
+}
+
+// Handler for the 'writestr' command: Writes a string to the file starting at the specified index
+void Terminal::handleWriteStr(const Tokens& tokens) {
+    if (tokens.size() >= 4) {
+        std::string_view userPath = tokens[1];
+        int index = toInt(tokens[2]);
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        FileManager* file = root->getFile(path);
+        if (!file) {
+            session.err << "ERROR: File not found in root folder." << std::endl;
+        } else {
+            WriteLock fileLock(tree->fileLock(file));
+            log();
+            file->write(index, restOf(tokens, 3));
+        }
+    }
+}
+
+// Handler for the 'append' command: Writes a string at the end of the file
+void Terminal::handleAppend(const Tokens& tokens) {
+    if (tokens.size() >= 3) {
+        std::string_view userPath = tokens[1];
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        FileManager* file = root->getFile(path);
+        if (!file) {
+            session.err << "ERROR: File not found in root folder." << std::endl;
+        } else {
+            WriteLock fileLock(tree->fileLock(file));
+            log();
+            file->append(restOf(tokens, 2));
+        }
+    }
+}
+
 // Handler for the 'cat' command: Displays the content of a file
-void Terminal::handleCat(const std::vector<std::string>& tokens) {
+void Terminal::handleCat(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        const std::string& userPath = tokens[1];
-        std::string internal = toInternalPath(userPath);
-        FileManager* file = root->getFile(internal);
+        std::string_view userPath = tokens[1];
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        const FileManager* file = root->getFile(path);
 
         if (!file) {
-            std::cerr << "ERROR: File not found in root folder." << std::endl;
+            session.err << "ERROR: File not found in root folder." << std::endl;
         } else {
-            file->cat(file->getFileName().c_str());
+            ReadLock fileLock(tree->fileLock(file));
+            file->cat(session.out);
         }
     }
 }
 
-// Handler for the 'wc' command: Displays word count of a file
-void Terminal::handleWc(const std::vector<std::string>& tokens) {
-    if (tokens.size() == 2) {
-        const std::string& userPath = tokens[1];
-        std::string internal = toInternalPath(userPath);
-        FileManager* file = root->getFile(internal);
+// Handler for the 'wc' command: Displays word count of a file, of several files,
+// or with -r of every file below the given folders; the files are counted on the thread pool
+void Terminal::handleWc(const Tokens& tokens) {
+    if (tokens.size() == 2 && tokens[1] != "-r") {
+        std::string_view userPath = tokens[1];
+        Path path(userPath);
+        ReadLock lock(tree->structure());
+        const FileManager* file = root->getFile(path);
 
         if (!file) {
-            std::cerr << "ERROR: File not found in root folder." << std::endl;
+            session.err << "ERROR: File not found in root folder." << std::endl;
         } else {
-            file->wc(file->getFileName().c_str());
+            ReadLock fileLock(tree->fileLock(file));
+            file->wc(session.out);
         }
+        return;
     }
+    bool recursive = tokens.size() > 1 && tokens[1] == "-r";
+    size_t first = recursive ? 2 : 1;
+    if (tokens.size() <= first) return;
+
+    ReadLock lock(tree->structure());
+    std::vector<const FileManager*> files;
+    for (size_t i = first; i < tokens.size(); ++i) {
+        Path path(tokens[i]);
+        if (recursive) {
+            root->collectFiles(path, session, files);
+        } else if (const FileManager* file = root->getFile(path)) {
+            files.push_back(file);
+        } else {
+            session.err << "ERROR: File not found: " << tokens[i] << std::endl;
+        }
+    }
+
+    std::vector<WordCount> counts(files.size());
+    ThreadPool& pool = ThreadPool::instance();
+    ThreadPool::Group group;
+    FolderTree& shared = *tree;
+    for (size_t i = 0; i < files.size(); ++i) {
+        pool.submit(group, [&counts, &files, &shared, i] {
+            ReadLock fileLock(shared.fileLock(files[i]));
+            counts[i] = files[i]->countWords();
+        });
+    }
+    pool.wait(group);
+
+    // Results are printed in collection order, whichever thread finished first
+    size_t lines = 0, words = 0, chars = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string name = files[i]->getFileName();
+        std::replace(name.begin(), name.end(), '#', '/');
+        session.out << name << ": " << counts[i] << '\n';
+        lines += counts[i].lines();
+        words += counts[i].words;
+        chars += counts[i].chars();
+    }
+    session.out << "Total: Lines: " << lines << ", Words: " << words << ", Characters: " << chars << std::endl;
 }
 
 // Handler for the 'copy' command: Copies a file to a new destination
-void Terminal::handleCopy(const std::vector<std::string>& tokens) {
+void Terminal::handleCopy(const Tokens& tokens) {
     if (tokens.size() == 3) {
-        const std::string& userSrc = tokens[1];
-        const std::string& userDst = tokens[2];
+        std::string_view userSrc = tokens[1];
+        std::string_view userDst = tokens[2];
 
-        std::string dstInternal = toInternalPath(userDst);
-        if (userDst[0] != 'V') { //this is for if the target pysc its mean nor begin with V/
-            dstInternal = "V#" + userDst;
-        }
+        //this is for if the target pysc its mean nor begin with V/
+        Path dst(userDst[0] != 'V' ? std::string("V/").append(userDst) : std::string(userDst));
+        WriteLock lock(tree->structure());
+        log();
 
         // Check if the destination folder exists
-        if (!root->folderExists(dstInternal)) {
-            std::cerr << "ERROR: Destination folder not found in root folder." << std::endl;
+        if (!root->folderExists(dst, session)) {
+            session.err << "ERROR: Destination folder not found in root folder." << std::endl;
             return;
         }
 
         if (userSrc[0] != 'V') { // Source is a physical file
-            std::string resolvedSrc = Terminal::pathpys + userSrc;
-            FileManager temp(resolvedSrc.c_str());
-            temp.touch(resolvedSrc.c_str());
-            FileManager dest(dstInternal.c_str());
-            dest.touch(dstInternal.c_str());
+            Path src(std::string(pathpys).append(userSrc));
+            FileManager temp(src.internal().c_str());
+            temp.touch(src.internal().c_str());
+            FileManager dest(dst.internal().c_str());
+            dest.touch(dst.internal().c_str());
             temp.copy(dest);
-            root->addFile(temp);
-            root->addFile(dest);
+            root->addFile(src, std::move(temp), session);
+            root->addFile(dst, std::move(dest), session);
         } else { // Source is virtual file
-            std::string srcInternal = toInternalPath(userSrc);
-            FileManager* srcFile = root->getFile(srcInternal);
+            FileManager* srcFile = root->getFile(Path(userSrc));
             if (!srcFile) {
-                std::cerr << "ERROR: Source file not found in root folder." << std::endl;
+                session.err << "ERROR: Source file not found in root folder." << std::endl;
             } else {
-                FileManager* dstFile = root->getFile(dstInternal);
+                FileManager* dstFile = root->getFile(dst);
                 if (!dstFile) {
-                    FileManager fm(dstInternal.c_str());
-                    fm.touch(dstInternal.c_str());
+                    FileManager fm(dst.internal().c_str());
+                    fm.touch(dst.internal().c_str());
                     srcFile->copy(fm);
-                    root->addFile(fm);
+                    root->addFile(dst, std::move(fm), session);
                 } else {
                     srcFile->copy(*dstFile);
                 }
@@ -207,112 +401,261 @@ void Terminal::handleCopy(const std::vector<std::string>& tokens) {
 
 
 // Handler for the 'move' command: Moves a file to a new folder
-void Terminal::handleMove(const std::vector<std::string>& tokens) {
+void Terminal::handleMove(const Tokens& tokens) {
     if (tokens.size() == 3) {
-        const std::string& userSrc = tokens[1];
-        std::string srcInternal = toInternalPath(userSrc);
-        FileManager* srcFile = root->getFile(srcInternal);
+        std::string_view userSrc = tokens[1];
+        Path src(userSrc);
+        Path dst(tokens[2]);
+        WriteLock lock(tree->structure());
+        log();
+        FileManager* srcFile = root->getFile(src);
         if (!srcFile) {
-            std::cerr << "ERROR: Source file not found in root folder." << std::endl;
+            session.err << "ERROR: Source file not found in root folder." << std::endl;
         } else {
-            const std::string& userDst = tokens[2];
-            std::string dstInternal = toInternalPath(userDst);
-            if (!root->folderExists(dstInternal)) {
-                std::cerr << "ERROR: Destination folder not found in root folder." << std::endl;
+            if (!root->folderExists(dst, session)) {
+                session.err << "ERROR: Destination folder not found in root folder." << std::endl;
             } else {
-                FileManager* dstFile = root->getFile(dstInternal);
+                FileManager* dstFile = root->getFile(dst);
                 if (!dstFile) {
-                    FileManager fm(dstInternal.c_str());
-                    fm.touch(dstInternal.c_str());
+                    FileManager fm(dst.internal().c_str());
+                    fm.touch(dst.internal().c_str());
                     srcFile->copy(fm);
-                    root->addFile(fm);
+                    root->addFile(dst, std::move(fm), session);
                 } else {
                     srcFile->copy(*dstFile);
                 }
-                root->removeFile(srcInternal);
+                root->removeFile(src, session);
             }
         }
     }
 }
 
 // Handler for the 'ln' command: Creates a symbolic link to a file
-void Terminal::handleLn(const std::vector<std::string>& tokens) {
+void Terminal::handleLn(const Tokens& tokens) {
     if (tokens.size() == 3) {
-        const std::string& userSrc = tokens[1];
-        const std::string& userDst = tokens[2];
-        std::string srcInternal = toInternalPath(userSrc);
-        std::string dstInternal = toInternalPath(userDst);
-        bool srcFolderExists = root->folderExists(srcInternal);
-        bool dstFolderExists = root->folderExists(dstInternal);
-        FileManager* srcFile = root->getFile(srcInternal);
-        FileManager* dstFile = root->getFile(dstInternal);
+        std::string_view userSrc = tokens[1];
+        std::string_view userDst = tokens[2];
+        Path src(userSrc);
+        Path dst(userDst);
+        WriteLock lock(tree->structure());
+        log();
+        bool srcFolderExists = root->folderExists(src, session);
+        bool dstFolderExists = root->folderExists(dst, session);
+        FileManager* srcFile = root->getFile(src);
+        FileManager* dstFile = root->getFile(dst);
         if (!srcFolderExists || !dstFolderExists || !srcFile || !dstFile) {
-            std::cerr << "ERROR: Source/Destination folder or file not found in root folder." << std::endl;
+            session.err << "ERROR: Source/Destination folder or file not found in root folder." << std::endl;
         } else {
             srcFile->ln(*dstFile);
         }
     }
 }
 
+// Collect the folders and files below the host directory host/rel as '/'-separated paths relative to host.
+// Entries are sorted within each folder and every folder comes before its contents; symbolic links are followed
+// to files only, so link cycles cannot loop. Subfolders that cannot be opened are reported to err.
+// Returns false if host/rel cannot be opened
+static bool listHostTree(const std::string& host, const std::string& rel,
+                         std::vector<std::string>& dirs, std::vector<std::string>& files, std::ostream& err) {
+    DIR* d = ::opendir(rel.empty() ? host.c_str() : (host + '/' + rel).c_str());
+    if (!d) return false;
+    std::vector<std::string> subdirs, regular;
+    while (dirent* e = ::readdir(d)) {
+        std::string name = e->d_name;
+        if (name == "." || name == "..") continue;
+        unsigned char type = e->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st{};
+            if (::fstatat(::dirfd(d), e->d_name, &st, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISREG(st.st_mode)) type = DT_REG;
+            else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) type = DT_DIR;
+            else continue;
+        }
+        if (type == DT_DIR) subdirs.push_back(std::move(name));
+        else if (type == DT_REG) regular.push_back(std::move(name));
+    }
+    ::closedir(d);
+    std::sort(subdirs.begin(), subdirs.end());
+    std::sort(regular.begin(), regular.end());
+    std::string prefix = rel.empty() ? rel : rel + '/';
+    for (const auto& f : regular) files.push_back(prefix + f);
+    for (const auto& sd : subdirs) {
+        std::string sub = prefix + sd;
+        dirs.push_back(sub);
+        if (!listHostTree(host, sub, dirs, files, err)) {
+            err << "ERROR: Unable to open directory: " << host << '/' << sub << std::endl;
+        }
+    }
+    return true;
+}
+
+// Handler for the 'import' command: Mirrors a host directory into an existing virtual folder.
+// The folder nodes are created in one pass, then the file contents are copied on the thread pool
+void Terminal::handleImport(const Tokens& tokens) {
+    if (tokens.size() == 3) {
+        std::string host(tokens[1]);
+        while (host.size() > 1 && host.back() == '/') host.pop_back();
+        std::vector<std::string> dirs, files;
+        if (!listHostTree(host, std::string(), dirs, files, session.err)) {
+            session.err << "ERROR: Unable to open directory: " << host << std::endl;
+            return;
+        }
+        WriteLock lock(tree->structure());
+        log();  // a replay imports the host files again
+        std::vector<FileManager*> added;
+        if (!root->addTree(Path(tokens[2]), dirs, files, added, session)) return;
+
+        // Files that already had contents are emptied here, so no copy still shares blocks with them
+        for (FileManager* fm : added) {
+            if (fm && fm->getSize() > 0) fm->clear();
+        }
+
+        std::vector<std::string> errors(files.size());
+        ThreadPool& pool = ThreadPool::instance();
+        ThreadPool::Group group;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!added[i]) continue;
+            pool.submit(group, [&host, &files, &added, &errors, i] {
+                try {
+                    added[i]->importFrom((host + '/' + files[i]).c_str());
+                } catch (const std::exception& e) {
+                    errors[i] = e.what();
+                }
+            });
+        }
+        pool.wait(group);
+        for (const auto& e : errors) {
+            if (!e.empty()) session.err << "ERROR: " << e << std::endl;
+        }
+    }
+}
+
 // Handler for the 'mkdir' command: Creates a new directory
-void Terminal::handleMkdir(const std::vector<std::string>& tokens) {
+void Terminal::handleMkdir(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        const std::string& path = tokens[1];
+        std::string_view path = tokens[1];
         if (path.empty() || path.back() != '/') {
-            std::cerr << "Error: Path must end with '/'" << std::endl;
+            session.err << "Error: Path must end with '/'" << std::endl;
             return;
         }
-        root->mkdir(path.c_str());
+        Path dir(path);
+        WriteLock lock(tree->structure());
+        log();
+        root->mkdir(dir, session);
     }
 }
 
 
 // Handler for the 'chdir' command: Changes the current directory
-void Terminal::handleChdir(const std::vector<std::string>& tokens) {
+void Terminal::handleChdir(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        const std::string& path = tokens[1];
+        std::string_view path = tokens[1];
         if (path.empty() || path.back() != '/') {
-            std::cout << "Error: Path must end with '/'" << std::endl;
+            session.out << "Error: Path must end with '/'" << std::endl;
             return;
         }
-        root->chdir(path.c_str());
-        Terminal::currpath=path;
-        Terminal::pathpys = toInternalPath(path);
+        Path dir(path);
+        ReadLock lock(tree->structure());  // only this session's cwd changes
+        log();  // later relative paths of the session depend on it
+        root->chdir(dir, session);
+        currpath = path;
+        pathpys = dir.internal() + '#';
     }
 }
 
 
 // Handler for the 'rmdir' command: Removes a directory
-void Terminal::handleRmdir(const std::vector<std::string>& tokens) {
+void Terminal::handleRmdir(const Tokens& tokens) {
+    if (tokens.size() == 2) {
+        Path dir(tokens[1]);
+        WriteLock lock(tree->structure());
+        log();
+        root->rmdir(dir, session);
+    }
+}
+
+// Handler for the 'save' command: Writes the whole tree with its file contents to a host file
+void Terminal::handleSave(const Tokens& tokens) {
+    if (tokens.size() == 2) {
+        WriteLock lock(tree->structure());  // no file is written while it is saved
+        Snapshot::save(*root, std::string(tokens[1]));
+    }
+}
+
+// Handler for the 'load' command: Adds the folders and files of a saved tree to the root
+void Terminal::handleLoad(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        root->rmdir(tokens[1].c_str());
+        WriteLock lock(tree->structure());
+        log();  // a replay loads the snapshot again
+        Snapshot::load(*root, std::string(tokens[1]), session);
     }
 }
 
 // Handler for the 'ls' command: Lists files and directories
-void Terminal::handleLs(const std::vector<std::string>& tokens) {
+void Terminal::handleLs(const Tokens& tokens) {
     if (tokens.size() == 2) {
-        if(Terminal::currpath.empty())
-            root->ls("V");
-        else if(Terminal::currpath == tokens[1])
-            root->ls(tokens[1].c_str());
+        ReadLock lock(tree->structure());
+        if(currpath.empty())
+            root->ls(Path("V"), session);
+        else if(currpath == tokens[1])
+            root->ls(Path(tokens[1]), session);
         else
-            std::cerr <<"Invalid input"<<std::endl;
+            session.err <<"Invalid input"<<std::endl;
     }
 }
 
-// Handler for the 'lproot' command: Lists all files in the root directory
-void Terminal::handleLproot() {
-    root->lproot();
+// Handler for the 'lproot' command: Lists all files in the root directory, optionally only N levels deep
+void Terminal::handleLproot(const Tokens& tokens) {
+    std::size_t maxDepth = SIZE_MAX;
+    if (tokens.size() == 3 && tokens[1] == "--depth") {
+        int depth = toInt(tokens[2]);
+        if (depth < 0) {
+            session.err << "lproot: depth must not be negative" << std::endl;
+            return;
+        }
+        maxDepth = static_cast<std::size_t>(depth);
+    } else if (tokens.size() != 1) {
+        session.err << "usage: lproot [--depth N]" << std::endl;
+        return;
+    }
+    ReadLock lock(tree->structure());
+    root->lproot(session.out, maxDepth);
 }
 
 // Handler for the 'pwd' command: Prints the current working directory
 void Terminal::handlePwd() {
-    Folder::pwd();
+    ReadLock lock(tree->structure());
+    Folder::pwd(session);
+}
+
+// Handler for the 'sync' command: Makes the journal and pending data durable
+void Terminal::handleSync() {
+    if (Journal* journal = tree->getJournal()) journal->sync();
+    Storage::get().syncAll();
+}
+
+// Handler for the 'cachestat' command: Prints page cache counters for sizing
+void Terminal::handleCacheStat() {
+    StreamStorage::CacheStats cache = StreamStorage::instance().cacheStats();
+    const PageCache::Stats& st = cache.counters;
+    session.out << "Pages: " << cache.pages << "/" << cache.capacity
+              << ", Dirty: " << cache.dirty
+              << ", Hits: " << st.hits
+              << ", Misses: " << st.misses
+              << ", Writebacks: " << st.writebacks
+              << ", Evictions: " << st.evictions
+              << ", Bypasses: " << st.bypasses << std::endl;
+}
+
+// Handler for the 'reapstat' command: Prints the reaper's queue: removed folders and files not deleted yet
+void Terminal::handleReapStat() {
+    Reaper::Stats st = Reaper::instance().getStats();
+    session.out << "Queued: " << st.queued
+                << ", Pending files: " << st.pending
+                << ", Removed files: " << st.removed << std::endl;
 }
 
-// Handler for the 'exit' command: Exits the terminal and cleans up
+// Handler for the 'exit' command: Stops the terminal; cleanup happens when it is destroyed
 void Terminal::handleExit() {
-    delete root;
-    exit(0);
+    running = false;  // the destructor writes back and removes the tree
 }
@@ -1,44 +1,107 @@
 #ifndef EX1_TERMINAL_H
 #define EX1_TERMINAL_H
 
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
-#include <functional>
 #include "Folder.h"
+#include "FolderTree.h"
 #include "FileManager.h"
+#include "Journal.h"
+#include "Storage.h"
 
+// Terminal class: one command session. Several sessions may share a FolderTree and run on different threads,
+// each with its own working directory and output streams
 class Terminal {
-    Folder* root;
-    static std::string currpath;
-    static std::string pathpys; //for if any file in system
-    // A map to hold command to function mappings
-    std::unordered_map<std::string, std::function<void(const std::vector<std::string>&)>> commandMap;
+public:
+    // Tokens of one command line, viewing the caller's line buffer
+    typedef std::vector<std::string_view> Tokens;
+
+private:
+    std::shared_ptr<FolderTree> tree;  // Folder hierarchy, shared with the other sessions
+    Folder* root;                      // Root of tree
+    Session session;                   // Working directory and streams of this session
+    std::string currpath;              // Path given to the last chdir, the only one ls accepts
+    std::string pathpys; //for if any file in system
+    bool running;  // Cleared by the 'exit' command
+    Tokens tokens; // Reused for every line so tokenizing does not allocate once warmed up
+    std::uint32_t id;       // Session number in the journal
+    std::string_view line;  // Command being executed, as it is logged
+    std::uint64_t logged;   // Journal record of that command, 0 if it was not logged
+    bool recovering;        // Replaying the journal: files are created over the leftovers of the crashed run
+
+    // Run the handler of the command in tokens
+    void dispatch();
+
+    // Log the current command; handlers that change the tree call it once they hold their locks,
+    // so conflicting commands reach the journal in the order they took effect
+    void log();
 
     // Command handlers
-    void handleTouch(const std::vector<std::string>& tokens);
-    void handleRemove(const std::vector<std::string>& tokens);
-    void handleRead(const std::vector<std::string>& tokens);
-    void handleWrite(const std::vector<std::string>& tokens);
-    void handleCat(const std::vector<std::string>& tokens);
-    void handleWc(const std::vector<std::string>& tokens);
-    void handleCopy(const std::vector<std::string>& tokens);
-    void handleMove(const std::vector<std::string>& tokens);
-    void handleLn(const std::vector<std::string>& tokens);
-    void handleMkdir(const std::vector<std::string>& tokens);
-    void handleChdir(const std::vector<std::string>& tokens);
-    void handleRmdir(const std::vector<std::string>& tokens);
-    void handleLs(const std::vector<std::string>& tokens);
-    void handleLproot();
-    static void handlePwd();
+    void handleTouch(const Tokens& tokens);
+    void handleRemove(const Tokens& tokens);
+    void handleRead(const Tokens& tokens);
+    void handleWrite(const Tokens& tokens);
+    void handleReadRange(const Tokens& tokens);
+    void handleWriteStr(const Tokens& tokens);
+    void handleAppend(const Tokens& tokens);
+    void handleCat(const Tokens& tokens);
+    void handleWc(const Tokens& tokens);
+    void handleCopy(const Tokens& tokens);
+    void handleMove(const Tokens& tokens);
+    void handleLn(const Tokens& tokens);
+    void handleImport(const Tokens& tokens);
+    void handleMkdir(const Tokens& tokens);
+    void handleChdir(const Tokens& tokens);
+    void handleRmdir(const Tokens& tokens);
+    void handleSave(const Tokens& tokens);
+    void handleLoad(const Tokens& tokens);
+    void handleLs(const Tokens& tokens);
+    void handleLproot(const Tokens& tokens);
+    void handlePwd();
+    void handleSync();
+    void handleCacheStat();
+    void handleReapStat();
     void handleExit();
 
 public:
-    Terminal();
+    // Start a session on a new tree whose file contents live in the given backend; throws if another tree
+    // still alive uses a different one
+    explicit Terminal(Storage::Mode mode = Storage::Stream,
+                      std::ostream& out = std::cout, std::ostream& err = std::cerr);
+
+    // Start another session on an existing tree, at its root
+    explicit Terminal(std::shared_ptr<FolderTree> tree,
+                      std::ostream& out = std::cout, std::ostream& err = std::cerr);
+
+    // Sessions are registered with the tree by address
+    Terminal(const Terminal&) = delete;
+    Terminal& operator=(const Terminal&) = delete;
+
     ~Terminal();
-    void executeCommand(const std::string& line);
-    static std::vector<std::string> tokenize(const std::string& line);
-    static std::string toInternalPath(const std::string& path);
+
+    // The tree this session works on, to start more sessions on it
+    const std::shared_ptr<FolderTree>& getTree() const { return tree; }
+
+    void executeCommand(std::string_view line);
+
+    // Rebuild the tree from the commands in journal, one session per logged session; returns how many ran
+    static std::size_t replay(const std::shared_ptr<FolderTree>& tree, Journal& journal);
+
+    bool isRunning() const { return running; }
+    static void tokenize(std::string_view line, Tokens& out);
+    static std::string_view restOf(const Tokens& tokens, size_t first);
+    static int toInt(std::string_view token);
+
+    // FNV-1a hash used to dispatch on the command name with a switch
+    static constexpr std::uint32_t commandHash(std::string_view name) {
+        std::uint32_t h = 2166136261u;
+        for (char c : name) h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+        return h;
+    }
 };
 
 #endif //EX1_TERMINAL_H
@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+
+// Set on the pool's worker threads
+static thread_local bool isWorker = false;
+
+// Returns the process-wide pool
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+// True on a worker thread
+bool ThreadPool::onWorker() {
+    return isWorker;
+}
+
+// Start the workers (at least one)
+ThreadPool::ThreadPool(std::size_t threads) : next(0), queued(0), stopping(false) {
+    if (threads == 0) threads = 1;
+    for (std::size_t i = 0; i < threads; ++i) queues.push_back(std::unique_ptr<Queue>(new Queue));
+    for (std::size_t i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+// Destructor: finishes the queued tasks and joins the workers
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+// Queue a task on the next worker in turn
+void ThreadPool::submit(Group& group, Task task) {
+    {
+        std::lock_guard<std::mutex> g(stateLock);
+        ++group.pending;
+    }
+    Queue& q = *queues[next++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> g(q.lock);
+        q.tasks.push_back(Job{std::move(task), &group});
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> g(stateLock);  // a worker checking queued cannot miss the signal
+    }
+    wake.notify_one();
+}
+
+// Block until every task of the group has finished
+void ThreadPool::wait(Group& group) {
+    std::unique_lock<std::mutex> g(stateLock);
+    group.idle.wait(g, [&group] { return group.pending == 0; });
+    if (group.failure) {
+        std::exception_ptr e = group.failure;
+        group.failure = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// Take from the back of the own queue (most recently queued, still warm), else steal from the front of another
+bool ThreadPool::take(std::size_t self, Job& job) {
+    std::size_t n = queues.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        Queue& q = *queues[(self + i) % n];
+        std::lock_guard<std::mutex> g(q.lock);
+        if (q.tasks.empty()) continue;
+        if (i == 0) {
+            job = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            job = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+// Worker loop
+void ThreadPool::run(std::size_t self) {
+    isWorker = true;
+    Job job;
+    for (;;) {
+        if (take(self, job)) {
+            Group& group = *job.group;
+            try {
+                job.task();
+            } catch (...) {
+                std::lock_guard<std::mutex> g(stateLock);
+                if (!group.failure) group.failure = std::current_exception();
+            }
+            job.task = nullptr;
+            std::lock_guard<std::mutex> g(stateLock);
+            if (--group.pending == 0) group.idle.notify_all();  // under the lock: the waiter may destroy group next
+            continue;
+        }
+        std::unique_lock<std::mutex> g(stateLock);
+        wake.wait(g, [this] { return queued > 0 || stopping; });
+        if (stopping && queued == 0) return;
+    }
+}
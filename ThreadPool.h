@@ -0,0 +1,86 @@
+#ifndef EX1_THREAD_POOL_H
+#define EX1_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ThreadPool class: process-wide set of worker threads with one task queue per worker.
+// Workers take tasks from the back of their own queue and steal from the front of the others,
+// so uneven tasks (one huge file among thousands of small ones) still keep every thread busy.
+// Each caller submits into its own Group and waits for that group only, so concurrent sessions
+// neither wait for each other's tasks nor receive each other's exceptions.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // Tasks submitted by one caller; must be waited for before it goes out of scope
+    class Group {
+    public:
+        Group() : pending(0) {}
+        Group(const Group&) = delete;
+        Group& operator=(const Group&) = delete;
+
+    private:
+        friend class ThreadPool;
+        std::size_t pending;           // Tasks submitted and not yet finished
+        std::exception_ptr failure;    // First exception thrown by one of them
+        std::condition_variable idle;  // Signalled when pending drops to zero
+    };
+
+    // Returns the process-wide pool (one worker per hardware thread)
+    static ThreadPool& instance();
+
+    // Queue a task of group; tasks are spread round-robin over the worker queues
+    void submit(Group& group, Task task);
+
+    // Block until every task of group has finished; rethrows the first exception one of them threw
+    void wait(Group& group);
+
+    // Number of worker threads
+    std::size_t size() const { return workers.size(); }
+
+    // True when called from one of the pool's worker threads (a task waiting for a group there can starve the pool)
+    static bool onWorker();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    struct Job {
+        Task task;
+        Group* group;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Job> tasks;
+    };
+
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    // Worker loop: run own tasks, then steal, then sleep until more work arrives
+    void run(std::size_t self);
+
+    // Take a task from the worker's own queue, or from another queue
+    bool take(std::size_t self, Job& job);
+
+    std::vector<std::unique_ptr<Queue>> queues;  // One queue per worker
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> next;               // Queue receiving the next submitted task
+    std::atomic<std::size_t> queued;             // Tasks waiting in any queue
+
+    std::mutex stateLock;                        // Guards the fields below and those of every Group
+    std::condition_variable wake;                // Signalled when tasks are queued or the pool stops
+    bool stopping;
+};
+
+#endif //EX1_THREAD_POOL_H
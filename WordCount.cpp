@@ -0,0 +1,147 @@
+#include "WordCount.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WC_X86 1
+#endif
+
+// Buffers below this size are counted on the calling thread
+static const std::size_t PARALLEL_MIN = 8 << 20;
+
+// Smallest chunk handed to one pool task
+static const std::size_t CHUNK_MIN = 4 << 20;
+
+// Same set as isspace() in the "C" locale: ' ', '\t', '\n', '\v', '\f', '\r'
+static inline bool isSpace(unsigned char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+// Scalar kernel: returns word starts, updates inWord and newlines
+static std::size_t countScalar(const char* data, std::size_t len, bool& inWord, std::size_t& newlines) {
+    std::size_t words = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        newlines += c == '\n';
+        bool word = !isSpace(c);
+        words += word && !inWord;
+        inWord = word;
+    }
+    return words;
+}
+
+#ifdef WC_X86
+// SSE2 kernel: 16 bytes per step, word starts are non-space bits whose previous bit is a space
+static std::size_t countSse2(const char* data, std::size_t len, bool& inWord, std::size_t& newlines) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i span = _mm_set1_epi8('\r' - '\t');
+    std::size_t words = 0;
+    std::uint32_t carry = inWord ? 1u : 0u;
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i ctl = _mm_sub_epi8(v, tab);
+        __m128i isCtl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, span), ctl);  // '\t'..'\r'
+        __m128i isSp = _mm_or_si128(isCtl, _mm_cmpeq_epi8(v, sp));
+        std::uint32_t word = ~static_cast<std::uint32_t>(_mm_movemask_epi8(isSp)) & 0xFFFFu;
+        std::uint32_t lines = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        words += static_cast<std::size_t>(__builtin_popcount(word & ~((word << 1) | carry)));
+        newlines += static_cast<std::size_t>(__builtin_popcount(lines));
+        carry = word >> 15;
+    }
+    inWord = carry != 0;
+    return words + countScalar(data + i, len - i, inWord, newlines);
+}
+
+// AVX2 kernel: 32 bytes per step
+__attribute__((target("avx2")))
+static std::size_t countAvx2(const char* data, std::size_t len, bool& inWord, std::size_t& newlines) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i span = _mm256_set1_epi8('\r' - '\t');
+    std::size_t words = 0;
+    std::uint64_t carry = inWord ? 1u : 0u;
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i ctl = _mm256_sub_epi8(v, tab);
+        __m256i isCtl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, span), ctl);
+        __m256i isSp = _mm256_or_si256(isCtl, _mm256_cmpeq_epi8(v, sp));
+        std::uint64_t word = ~static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(isSp)))
+                             & 0xFFFFFFFFull;
+        std::uint32_t lines = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        words += static_cast<std::size_t>(__builtin_popcountll(word & ~((word << 1) | carry)));
+        newlines += static_cast<std::size_t>(__builtin_popcount(lines));
+        carry = word >> 31;
+    }
+    inWord = carry != 0;
+    return words + countSse2(data + i, len - i, inWord, newlines);
+}
+#endif
+
+// Count one block with the fastest kernel the CPU supports
+WordCount WordCount::count(const char* data, std::size_t len) {
+    WordCount wc;
+    wc.bytes = len;
+    if (len == 0) return wc;
+    bool inWord = false;
+#ifdef WC_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    wc.words = avx2 ? countAvx2(data, len, inWord, wc.newlines) : countSse2(data, len, inWord, wc.newlines);
+#else
+    wc.words = countScalar(data, len, inWord, wc.newlines);
+#endif
+    wc.firstInWord = !isSpace(static_cast<unsigned char>(data[0]));
+    wc.lastInWord = inWord;
+    wc.last = data[len - 1];
+    return wc;
+}
+
+// Append the counts of the block that directly follows this one
+void WordCount::merge(const WordCount& next) {
+    if (next.bytes == 0) return;
+    if (bytes == 0) {
+        *this = next;
+        return;
+    }
+    newlines += next.newlines;
+    words += next.words;
+    if (lastInWord && next.firstInWord) --words;  // one word spans the boundary
+    bytes += next.bytes;
+    lastInWord = next.lastInWord;
+    last = next.last;
+}
+
+// Count a whole buffer, splitting large ones into pool tasks; on a pool worker the caller is already
+// one of several parallel tasks, so the buffer is counted in place
+WordCount WordCount::countParallel(const char* data, std::size_t len) {
+    if (len < PARALLEL_MIN || ThreadPool::onWorker()) return count(data, len);
+    ThreadPool& pool = ThreadPool::instance();
+    std::size_t chunks = std::min(pool.size(), len / CHUNK_MIN);
+    if (chunks < 2) return count(data, len);
+
+    std::vector<WordCount> parts(chunks);
+    std::size_t chunk = len / chunks;
+    ThreadPool::Group group;
+    for (std::size_t t = 0; t < chunks; ++t) {
+        std::size_t begin = t * chunk;
+        std::size_t size = t + 1 == chunks ? len - begin : chunk;
+        pool.submit(group, [&parts, data, t, begin, size] { parts[t] = count(data + begin, size); });
+    }
+    pool.wait(group);
+
+    WordCount total;
+    for (const auto& p : parts) total.merge(p);
+    return total;
+}
+
+// Print the counts of a whole file in the wc format
+std::ostream& operator<<(std::ostream& out, const WordCount& wc) {
+    return out << "Lines: " << wc.lines() << ", Words: " << wc.words << ", Characters: " << wc.chars();
+}
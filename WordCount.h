@@ -0,0 +1,38 @@
+#ifndef EX1_WORD_COUNT_H
+#define EX1_WORD_COUNT_H
+
+#include <cstddef>
+#include <ostream>
+
+// WordCount class: newline / word / byte counts of a block of bytes.
+// Words are runs of non-space bytes (space as in the "C" locale isspace), counted by their first byte.
+// Counts of consecutive blocks can be merged, so a buffer can be split and counted in parallel.
+class WordCount {
+public:
+    std::size_t newlines = 0;  // '\n' bytes
+    std::size_t words = 0;     // Word starts, assuming the byte before the block is a space
+    std::size_t bytes = 0;     // All bytes, newlines included
+    bool firstInWord = false;  // The block starts with a non-space byte
+    bool lastInWord = false;   // The block ends with a non-space byte
+    char last = '\n';          // Last byte of the block ('\n' if empty)
+
+    // Count one block with the fastest kernel the CPU supports (AVX2, SSE2, else scalar)
+    static WordCount count(const char* data, std::size_t len);
+
+    // Count a whole buffer; large buffers are split into chunks counted by ThreadPool tasks
+    static WordCount countParallel(const char* data, std::size_t len);
+
+    // Append the counts of the block that directly follows this one
+    void merge(const WordCount& next);
+
+    // Lines as wc reports them: a trailing line without '\n' still counts
+    std::size_t lines() const { return newlines + (last != '\n' ? 1 : 0); }
+
+    // Characters as wc reports them: every byte but the newlines
+    std::size_t chars() const { return bytes - newlines; }
+};
+
+// Print the counts of a whole file in the wc format
+std::ostream& operator<<(std::ostream& out, const WordCount& wc);
+
+#endif //EX1_WORD_COUNT_H
@@ -1,16 +1,109 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
 #include <iostream>
 #include <string>
 #include "Terminal.h"
+#include "HandlePool.h"
+#include "ImageStorage.h"
+#include "MmapStorage.h"
+#include "PageCache.h"
+#include "ScriptRunner.h"
+#include "SessionBench.h"
+#include "SocketServer.h"
+#include "LoadClient.h"
+
+int main(int argc, char* argv[]) {
+    Storage::Mode mode = Storage::Stream;
+    const char* script = nullptr;
+    int bench = 0;
+    const char* listen = nullptr;
+    const char* load = nullptr;
+    int connections = 4, requests = 100000, depth = 16;
+    const char* journalPath = nullptr;
+    const char* snapshot = nullptr;
+    Journal::Policy policy = Journal::EveryOp;
+    unsigned interval = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mmap") mode = Storage::Mmap; //Keep file contents in memory-mapped backing files
+        else if (arg == "--memory") mode = Storage::Memory; //Keep file contents in memory only
+        else if (arg == "--image" && i + 1 < argc) { //Pack every file into one image file
+            mode = Storage::Image;
+            ImageStorage::setPath(argv[++i]);
+        }
+        else if (arg == "--handles" && i + 1 < argc) { //Keep at most N backing files open at once
+            HandlePool::instance().setCapacity(static_cast<std::size_t>(std::max(std::atoi(argv[++i]), 2)));
+        }
+        else if (arg == "--flush" && i + 1 < argc) { //When file data reaches the device: sync, or every-write
+            std::string when = argv[++i];
+            HandlePool::instance().setFlushPolicy(when == "every-write" ? HandlePool::FlushEveryWrite
+                                                                        : HandlePool::FlushOnSync);
+        }
+        else if (arg == "--cache-pages" && i + 1 < argc) { //Cache at most N pages of the stream backend
+            PageCache::instance().setCapacity(static_cast<std::size_t>(std::max(std::atoi(argv[++i]), 1)));
+        }
+        else if (arg == "--maps" && i + 1 < argc) { //Keep at most N files mapped with --mmap
+            MmapStorage::setCapacity(static_cast<std::size_t>(std::max(std::atoi(argv[++i]), 2)));
+        }
+        else if (arg == "--script" && i + 1 < argc) script = argv[++i]; //Run a script file non-interactively
+        else if (arg == "--bench" && i + 1 < argc) bench = std::atoi(argv[++i]); //Time up to N concurrent sessions
+        else if (arg == "--listen" && i + 1 < argc) listen = argv[++i]; //Serve clients on a Unix-domain socket
+        else if (arg == "--load" && i + 1 < argc) load = argv[++i]; //Generate load against a listening server
+        else if (arg == "--connections" && i + 1 < argc) connections = std::atoi(argv[++i]);
+        else if (arg == "--requests" && i + 1 < argc) requests = std::atoi(argv[++i]);
+        else if (arg == "--depth" && i + 1 < argc) depth = std::atoi(argv[++i]);
+        else if (arg == "--restore" && i + 1 < argc) snapshot = argv[++i]; //Start from a tree saved with 'save'
+        else if (arg == "--journal" && i + 1 < argc) journalPath = argv[++i]; //Log changes and recover them after a crash
+        else if (arg == "--fsync" && i + 1 < argc) { //When the journal is synced: always, sync, or every N ms
+            std::string when = argv[++i];
+            if (when == "always") policy = Journal::EveryOp;
+            else if (when == "sync") policy = Journal::OnSync;
+            else {
+                policy = Journal::Interval;
+                interval = static_cast<unsigned>(std::max(std::atoi(when.c_str()), 1));
+            }
+        }
+    }
+
+    if (bench > 0) return SessionBench::run(mode, static_cast<unsigned>(bench));
+    if (load) {
+        return LoadClient::run(load, static_cast<unsigned>(std::max(connections, 1)),
+                               static_cast<std::size_t>(std::max(requests, 1)), static_cast<unsigned>(std::max(depth, 1)));
+    }
+
+    Terminal terminal(mode); //Create mini-terminal
+    if (snapshot) {
+        try {
+            terminal.getTree()->loadSnapshot(snapshot);
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (journalPath) {
+        std::unique_ptr<Journal> journal(new Journal(journalPath, policy, interval));
+        if (!journal->good()) {
+            std::cerr << "Unable to open journal: " << journalPath << std::endl;
+            return 1;
+        }
+        std::size_t recovered = Terminal::replay(terminal.getTree(), *journal);
+        if (recovered) std::cout << "Recovered " << recovered << " commands from " << journalPath << std::endl;
+        terminal.getTree()->setJournal(std::move(journal));
+    }
+    if (listen) {
+        SocketServer server(terminal.getTree()); //Every client gets its own session on the terminal's tree
+        return server.run(listen) ? 0 : 1;
+    }
+    if (script) {
+        ScriptRunner runner(terminal);
+        return runner.run(script) == 0 ? 0 : 1;
+    }
 
-int main() {
-    Terminal terminal; //Create mini-terminal
     std::string line;
-    while (std::getline(std::cin, line)) {
+    while (terminal.isRunning() && std::getline(std::cin, line)) {
         terminal.executeCommand(line); //Read the command from the user and action until exit
     }
 
     return 0;
 }
-
-
-